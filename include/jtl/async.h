@@ -1,30 +1,45 @@
 #ifndef JTL_ASYNC_H
 #define JTL_ASYNC_H
 
-#include <future> // std::future
+#include "scheduler.h"
+#include "future.h"
+
+#include <functional> // std::bind
+#include <utility> // std::forward, std::move, std::declval
 
 namespace jtl
 {
-#if 0
-	template< class Function, class... Args>
-	std::future<typename std::result_of<Function(Args...)>::type> async(Function&& f, Args&&... args)
+	template<typename R, typename BoundTask>
+	struct AsyncTask
 	{
-		return std::async(std::launch::async, std::forward<Function>(f), std::forward<Args>(args)...);
-	}
-#else
+		promise<R> m_Promise;
+		BoundTask m_Task;
+
+		AsyncTask(promise<R>&& p, BoundTask&& task)
+			: m_Promise(std::move(p))
+			, m_Task(std::move(task))
+		{
+		}
+
+		void operator()()
+		{
+			FutureApply<R>::apply(m_Promise, m_Task);
+		}
+	};
+
+	// Runs f on the default scheduler.
 	template< class Function, class... Args>
-	std::future<typename std::result_of<Function(Args...)>::type> async(Function&& f, Args&&... args)
+	future<decltype(std::declval<Function>()(std::declval<Args>()...))> async(Function&& f, Args&&... args)
 	{
-		typedef typename std::result_of<Function(Args...)>::type R;
+		typedef decltype(std::declval<Function>()(std::declval<Args>()...)) R;
 		auto bound_task = std::bind(std::forward<Function>(f), std::forward<Args>(args)...);
-		std::packaged_task<R()> task(std::move(bound_task));
-		auto ret = task.get_future();
-		std::thread t(std::move(task));
-		t.detach();
+		typedef AsyncTask<R, decltype(bound_task)> TaskT;
+
+		promise<R> p;
+		future<R> ret = p.get_future();
+		getDefaultScheduler()->run(TaskT(std::move(p), std::move(bound_task)));
 		return ret;
 	}
-#endif
-
 }
 
 #endif
@@ -0,0 +1,67 @@
+#ifndef JTL_ATOMIC_H
+#define JTL_ATOMIC_H
+
+#include <stdint.h>
+#include <bx/bx.h>
+#include <bx/cpu.h>
+
+namespace jtl
+{
+// Helpers on top of bx's atomics, which only provide CAS for 32/64-bit integers.
+
+// Returns the previous value of *ptr (the exchange happened iff it's equal to oldValue).
+template<typename T>
+inline T* atomicCompareAndSwapPtr(T* volatile* ptr, T* oldValue, T* newValue)
+{
+#if BX_ARCH_64BIT
+	return (T*)(uintptr_t)bx::atomicCompareAndSwap<uint64_t>((volatile uint64_t*)ptr, (uint64_t)(uintptr_t)oldValue, (uint64_t)(uintptr_t)newValue);
+#else
+	return (T*)(uintptr_t)bx::atomicCompareAndSwap<uint32_t>((volatile uint32_t*)ptr, (uint32_t)(uintptr_t)oldValue, (uint32_t)(uintptr_t)newValue);
+#endif
+}
+
+template<typename T>
+inline T* atomicExchangePtr(T* volatile* ptr, T* value)
+{
+	return (T*)bx::atomicExchangePtr((void**)ptr, (void*)value);
+}
+
+// Load with acquire and store with release semantics, for values up to 64 bits
+// (integers, pointers, floats and doubles). A store is visible to a thread which
+// loads the value along with everything written before it.
+template<typename T>
+inline T atomicLoad(const T* ptr)
+{
+#if BX_COMPILER_MSVC
+	// Volatile accesses are acquire/release with /volatile:ms (the default on x86/x64).
+	const T value = *(const volatile T*)ptr;
+#	if BX_CPU_ARM
+	__dmb(_ARM64_BARRIER_ISH);
+#	else
+	_ReadWriteBarrier();
+#	endif
+	return value;
+#else
+	T value;
+	__atomic_load(ptr, &value, __ATOMIC_ACQUIRE);
+	return value;
+#endif
+}
+
+template<typename T>
+inline void atomicStore(T* ptr, T value)
+{
+#if BX_COMPILER_MSVC
+#	if BX_CPU_ARM
+	__dmb(_ARM64_BARRIER_ISH);
+#	else
+	_ReadWriteBarrier();
+#	endif
+	*(volatile T*)ptr = value;
+#else
+	__atomic_store(ptr, &value, __ATOMIC_RELEASE);
+#endif
+}
+}
+
+#endif
@@ -0,0 +1,273 @@
+#ifndef JTL_ATOMIC_SHARED_PTR_H
+#define JTL_ATOMIC_SHARED_PTR_H
+
+#include <stdint.h>
+#include <bx/allocator.h>
+#include <bx/cpu.h>
+#include "jtl.h"
+#include "atomic.h"
+#include "shared_ptr.h"
+
+namespace jtl
+{
+// shared_ptr which can be loaded and replaced concurrently from any number of threads
+// without locks, e.g. for publishing read-mostly data (configs, lookup tables) to readers.
+//
+// The current value lives in a node (a shared_ptr<T> plus a reference count) and the
+// atomic word packs the node pointer (low 48 bits) with the number of loads in progress
+// (high 16 bits). A load increments the latter with a single atomic add, copies the
+// shared_ptr out of the node and then gives its borrowed reference back: by decrementing
+// the local count if the node is still current, or the node's own count if it has been
+// replaced in the meantime. A store swaps in a new node and transfers the local count
+// of the old one to its own count, offset by a large bias so that loads which finish
+// before the transfer can't bring it down to 0 early.
+//
+// At most 65535 loads can be in progress on the same atomic_shared_ptr at the same time.
+// Every store allocates a node from the specified allocator.
+template<typename T>
+class atomic_shared_ptr
+{
+public:
+	atomic_shared_ptr(bx::AllocatorI* allocator = nullptr);
+	explicit atomic_shared_ptr(const shared_ptr<T>& value, bx::AllocatorI* allocator = nullptr);
+	~atomic_shared_ptr();
+
+	shared_ptr<T> load() const;
+	void store(const shared_ptr<T>& value);
+	shared_ptr<T> exchange(const shared_ptr<T>& value);
+
+	// Replaces the value with desired if it's the same as expected (same object and same
+	// control block). Otherwise, expected is set to the current value.
+	bool compare_exchange(shared_ptr<T>& expected, const shared_ptr<T>& desired);
+
+private:
+	struct Node
+	{
+		int32_t m_Count;
+		bx::AllocatorI* m_Allocator;
+		shared_ptr<T> m_Value;
+	};
+
+	static const uint32_t kPointerBits = 48;
+	static const uint64_t kPointerMask = (1ull << kPointerBits) - 1;
+	static const uint64_t kOneBorrow = 1ull << kPointerBits;
+	static const int32_t kBias = 1 << 30;
+
+	uint64_t m_Word;
+	bx::AllocatorI* m_Allocator;
+
+	Node* createNode(const shared_ptr<T>& value);
+	Node* acquire() const;
+	void releaseBorrow(Node* node) const;
+	uint64_t swapNode(Node* node);
+	void retire(uint64_t word);
+
+	static Node* getNode(uint64_t word);
+	static void releaseNode(Node* node, int32_t count);
+
+	atomic_shared_ptr(const atomic_shared_ptr&) = delete;
+	atomic_shared_ptr& operator = (const atomic_shared_ptr&) = delete;
+};
+
+template<typename T>
+inline atomic_shared_ptr<T>::atomic_shared_ptr(bx::AllocatorI* allocator)
+	: m_Word(0)
+	, m_Allocator(allocator ? allocator : getDefaultAllocator())
+{
+}
+
+template<typename T>
+inline atomic_shared_ptr<T>::atomic_shared_ptr(const shared_ptr<T>& value, bx::AllocatorI* allocator)
+	: m_Word(0)
+	, m_Allocator(allocator ? allocator : getDefaultAllocator())
+{
+	m_Word = (uint64_t)(uintptr_t)createNode(value);
+}
+
+template<typename T>
+inline atomic_shared_ptr<T>::~atomic_shared_ptr()
+{
+	retire(m_Word);
+}
+
+template<typename T>
+inline shared_ptr<T> atomic_shared_ptr<T>::load() const
+{
+	Node* node = acquire();
+	if (!node) {
+		return shared_ptr<T>();
+	}
+
+	shared_ptr<T> ret(node->m_Value);
+	releaseBorrow(node);
+	return ret;
+}
+
+template<typename T>
+inline void atomic_shared_ptr<T>::store(const shared_ptr<T>& value)
+{
+	retire(swapNode(createNode(value)));
+}
+
+template<typename T>
+inline shared_ptr<T> atomic_shared_ptr<T>::exchange(const shared_ptr<T>& value)
+{
+	const uint64_t prev = swapNode(createNode(value));
+
+	// The old node can't go away before it's retired by this thread.
+	Node* node = getNode(prev);
+	shared_ptr<T> ret = node ? node->m_Value : shared_ptr<T>();
+	retire(prev);
+	return ret;
+}
+
+template<typename T>
+inline bool atomic_shared_ptr<T>::compare_exchange(shared_ptr<T>& expected, const shared_ptr<T>& desired)
+{
+	Node* newNode = nullptr;
+	for (;;) {
+		// Borrow the current node in order to compare its value. While the borrow is held
+		// the node can't be freed (and its address can't be reused).
+		Node* node = acquire();
+		const bool equal = node
+			? node->m_Value.m_Value == expected.m_Value && node->m_Value.m_RefCount == expected.m_RefCount
+			: !expected.m_Value && !expected.m_RefCount
+			;
+
+		if (!equal) {
+			expected = node ? node->m_Value : shared_ptr<T>();
+			if (node) {
+				releaseBorrow(node);
+			}
+
+			if (newNode) {
+				releaseNode(newNode, kBias);
+			}
+			return false;
+		}
+
+		if (!newNode) {
+			newNode = createNode(desired);
+		}
+
+		uint64_t word = atomicLoad(&m_Word);
+		while (getNode(word) == node) {
+			const uint64_t prev = bx::atomicCompareAndSwap<uint64_t>(&m_Word, word, (uint64_t)(uintptr_t)newNode);
+			if (prev == word) {
+				// The local count includes this thread's borrow, which is released below
+				// through the node's count since the node isn't current anymore.
+				retire(word);
+				if (node) {
+					releaseBorrow(node);
+				}
+				return true;
+			}
+			word = prev;
+		}
+
+		// Replaced by someone else in the meantime. Try again with the new value.
+		if (node) {
+			releaseBorrow(node);
+		}
+	}
+}
+
+template<typename T>
+inline typename atomic_shared_ptr<T>::Node* atomic_shared_ptr<T>::createNode(const shared_ptr<T>& value)
+{
+	if (!value.m_RefCount) {
+		return nullptr;
+	}
+
+	Node* node = (Node*)BX_ALLOC(m_Allocator, sizeof(Node));
+	JTL_CHECK(node, "Allocation failed");
+	node->m_Count = kBias;
+	node->m_Allocator = m_Allocator;
+	BX_PLACEMENT_NEW(&node->m_Value, shared_ptr<T>)(value);
+
+	JTL_CHECK(((uintptr_t)node & ~kPointerMask) == 0, "Pointer doesn't fit in 48 bits");
+	return node;
+}
+
+// Increments the local count of the current node.
+template<typename T>
+inline typename atomic_shared_ptr<T>::Node* atomic_shared_ptr<T>::acquire() const
+{
+	uint64_t* word = const_cast<uint64_t*>(&m_Word);
+	if (!getNode(atomicLoad(word))) {
+		return nullptr;
+	}
+
+	Node* node = getNode(bx::atomicFetchAndAdd<uint64_t>(word, kOneBorrow));
+	if (!node) {
+		// Cleared between the load and the increment. The borrow on an empty word is
+		// simply dropped when the word is replaced, otherwise undo it.
+		releaseBorrow(nullptr);
+	}
+
+	return node;
+}
+
+template<typename T>
+inline void atomic_shared_ptr<T>::releaseBorrow(Node* node) const
+{
+	uint64_t* word = const_cast<uint64_t*>(&m_Word);
+	uint64_t cur = atomicLoad(word);
+	while (getNode(cur) == node) {
+		JTL_CHECK((cur >> kPointerBits) != 0, "Invalid borrow count");
+		const uint64_t prev = bx::atomicCompareAndSwap<uint64_t>(word, cur, cur - kOneBorrow);
+		if (prev == cur) {
+			return;
+		}
+		cur = prev;
+	}
+
+	// The node has been replaced and the borrow transferred to its count.
+	if (node) {
+		releaseNode(node, 1);
+	}
+}
+
+template<typename T>
+inline uint64_t atomic_shared_ptr<T>::swapNode(Node* node)
+{
+	uint64_t word = atomicLoad(&m_Word);
+	for (;;) {
+		const uint64_t prev = bx::atomicCompareAndSwap<uint64_t>(&m_Word, word, (uint64_t)(uintptr_t)node);
+		if (prev == word) {
+			return prev;
+		}
+		word = prev;
+	}
+}
+
+// Transfers the borrows of a word which has been swapped out to its node and drops the
+// reference the word held.
+template<typename T>
+inline void atomic_shared_ptr<T>::retire(uint64_t word)
+{
+	Node* node = getNode(word);
+	if (node) {
+		const int32_t numBorrows = (int32_t)(word >> kPointerBits);
+		releaseNode(node, kBias - numBorrows);
+	}
+}
+
+template<typename T>
+inline typename atomic_shared_ptr<T>::Node* atomic_shared_ptr<T>::getNode(uint64_t word)
+{
+	return (Node*)(uintptr_t)(word & kPointerMask);
+}
+
+template<typename T>
+inline void atomic_shared_ptr<T>::releaseNode(Node* node, int32_t count)
+{
+	if (bx::atomicSubAndFetch(&node->m_Count, count) == 0) {
+		bx::AllocatorI* allocator = node->m_Allocator;
+		node->m_Value.~shared_ptr();
+		BX_FREE(allocator, node);
+	}
+}
+}
+
+#endif
@@ -0,0 +1,376 @@
+#ifndef JTL_CONCURRENT_STATS_H
+#define JTL_CONCURRENT_STATS_H
+
+#include <stdint.h>
+#include <bx/bx.h>
+#include <bx/allocator.h>
+#include <bx/math.h>
+#include "jtl.h"
+#include "atomic.h"
+#include "histogram.h"
+
+namespace jtl
+{
+static const uint32_t kMaxThreadSlots = 64;
+
+// Returns a small index identifying the calling thread among the live threads, in
+// [0, kMaxThreadSlots). Slots are released when threads exit and reused by new threads.
+// Returns kMaxThreadSlots if all of them are in use.
+uint32_t getThreadSlot();
+
+// Spin lock guarding the shards shared by the threads which didn't get a slot.
+void sharedShardLock(int32_t* lock);
+void sharedShardUnlock(int32_t* lock);
+
+struct stats_snapshot
+{
+	uint64_t m_Count;
+	double m_Sum;
+	double m_SumSq;
+	double m_Min;
+	double m_Max;
+
+	stats_snapshot();
+
+	double getMean() const;
+	double getVariance() const;
+	double getStdDev() const;
+
+	void merge(const stats_snapshot& other);
+};
+
+// One cache line per thread slot. Only the owning thread writes to it (except for the
+// shared shard, which is written under a lock), so updates are atomic stores rather than
+// read-modify-write operations.
+BX_ALIGN_DECL_CACHE_LINE(struct) StatsShard
+{
+	uint64_t m_Count;
+	double m_Sum;
+	double m_SumSq;
+	double m_Min;
+	double m_Max;
+	double m_IntervalMin; // Bounds of the values recorded since the interval m_Generation started
+	double m_IntervalMax;
+	uint32_t m_Generation;
+};
+
+// Count, sum, sum of squares and bounds of values recorded concurrently by any number of
+// threads. Every thread updates its own cache-line sized shard with atomic stores (no
+// locked instructions, no sharing between writers), and the shards are merged when the
+// stats are read. Threads beyond kMaxThreadSlots share a shard guarded by a spin lock.
+//
+// read() returns the totals since construction. drain() returns the stats since the
+// previous call to drain(), e.g. once per tick to feed moving averages or rates with
+// the snapshot's mean/count:
+//
+//	stats_snapshot s;
+//	stats.drain(s);
+//	latencyAverage.insert(s.getMean());
+//
+// Readers see every shard field atomically, but not every shard at the same instant;
+// values recorded while a read is in progress might only be accounted for by the next
+// one. Only one thread may call drain() at a time.
+class concurrent_stats
+{
+public:
+	concurrent_stats(bx::AllocatorI* allocator = nullptr);
+	~concurrent_stats();
+
+	void record(double value);
+
+	void read(stats_snapshot& snapshot) const;
+	void drain(stats_snapshot& snapshot);
+
+private:
+	bx::AllocatorI* m_Allocator;
+	StatsShard* m_Shards[kMaxThreadSlots + 1]; // The last one is shared
+	stats_snapshot m_Drained; // Totals at the last drain()
+	uint32_t m_Generation; // Incremented by drain()
+	int32_t m_SharedLock;
+
+	StatsShard* createShard(uint32_t slot);
+	void recordShared(double value);
+
+	static void recordShard(StatsShard* shard, double value, uint32_t generation);
+
+	concurrent_stats(const concurrent_stats&) = delete;
+	concurrent_stats& operator = (const concurrent_stats&) = delete;
+};
+
+// Sharded histogram. Every thread records into its own histogram, allocated the first
+// time the thread records a value; read() and drain() merge them the same way
+// concurrent_stats does. The count of a snapshot is the sum of its bucket counts, which
+// might include values whose sum hasn't been loaded yet.
+template<uint32_t PrecisionBits = 7>
+class concurrent_histogram
+{
+public:
+	typedef histogram<PrecisionBits> histogram_type;
+
+	concurrent_histogram(bx::AllocatorI* allocator = nullptr);
+	~concurrent_histogram();
+
+	void record(uint64_t value, uint64_t count = 1);
+
+	void read(histogram_type& snapshot) const;
+	void drain(histogram_type& snapshot);
+
+private:
+	bx::AllocatorI* m_Allocator;
+	histogram_type* m_Shards[kMaxThreadSlots + 1]; // The last one is shared
+	histogram_type* m_Drained; // Totals at the last drain()
+	int32_t m_SharedLock;
+
+	histogram_type* createShard(uint32_t slot);
+
+	static void recordShard(histogram_type* shard, uint64_t value, uint64_t count);
+	static void mergeShard(histogram_type& snapshot, const histogram_type* shard);
+
+	concurrent_histogram(const concurrent_histogram&) = delete;
+	concurrent_histogram& operator = (const concurrent_histogram&) = delete;
+};
+
+inline stats_snapshot::stats_snapshot()
+	: m_Count(0)
+	, m_Sum(0.0)
+	, m_SumSq(0.0)
+	, m_Min(0.0)
+	, m_Max(0.0)
+{
+}
+
+inline double stats_snapshot::getMean() const
+{
+	return m_Count ? m_Sum / (double)m_Count : 0.0;
+}
+
+inline double stats_snapshot::getVariance() const
+{
+	if (!m_Count) {
+		return 0.0;
+	}
+
+	const double mean = getMean();
+	const double variance = m_SumSq / (double)m_Count - mean * mean;
+	return variance > 0.0 ? variance : 0.0;
+}
+
+inline double stats_snapshot::getStdDev() const
+{
+	return (double)bx::sqrt((float)getVariance());
+}
+
+inline void stats_snapshot::merge(const stats_snapshot& other)
+{
+	if (!other.m_Count) {
+		return;
+	}
+
+	m_Min = m_Count ? bx::min(m_Min, other.m_Min) : other.m_Min;
+	m_Max = m_Count ? bx::max(m_Max, other.m_Max) : other.m_Max;
+	m_Count += other.m_Count;
+	m_Sum += other.m_Sum;
+	m_SumSq += other.m_SumSq;
+}
+
+inline void concurrent_stats::record(double value)
+{
+	const uint32_t slot = getThreadSlot();
+	if (slot == kMaxThreadSlots) {
+		recordShared(value);
+		return;
+	}
+
+	StatsShard* shard = m_Shards[slot];
+	if (BX_UNLIKELY(!shard)) {
+		shard = createShard(slot);
+	}
+
+	recordShard(shard, value, atomicLoad(&m_Generation));
+}
+
+inline void concurrent_stats::recordShard(StatsShard* shard, double value, uint32_t generation)
+{
+	const uint64_t count = shard->m_Count;
+	if (count == 0) {
+		atomicStore(&shard->m_Min, value);
+		atomicStore(&shard->m_Max, value);
+	} else {
+		if (value < shard->m_Min) {
+			atomicStore(&shard->m_Min, value);
+		}
+		if (value > shard->m_Max) {
+			atomicStore(&shard->m_Max, value);
+		}
+	}
+
+	if (shard->m_Generation != generation) {
+		atomicStore(&shard->m_IntervalMin, value);
+		atomicStore(&shard->m_IntervalMax, value);
+		atomicStore(&shard->m_Generation, generation);
+	} else {
+		if (value < shard->m_IntervalMin) {
+			atomicStore(&shard->m_IntervalMin, value);
+		}
+		if (value > shard->m_IntervalMax) {
+			atomicStore(&shard->m_IntervalMax, value);
+		}
+	}
+
+	atomicStore(&shard->m_Sum, shard->m_Sum + value);
+	atomicStore(&shard->m_SumSq, shard->m_SumSq + value * value);
+	atomicStore(&shard->m_Count, count + 1);
+}
+
+template<uint32_t PrecisionBits>
+concurrent_histogram<PrecisionBits>::concurrent_histogram(bx::AllocatorI* allocator)
+	: m_Allocator(allocator ? allocator : getDefaultAllocator())
+	, m_Drained(nullptr)
+	, m_SharedLock(0)
+{
+	bx::memSet(m_Shards, 0, sizeof(m_Shards));
+}
+
+template<uint32_t PrecisionBits>
+concurrent_histogram<PrecisionBits>::~concurrent_histogram()
+{
+	for (uint32_t i = 0; i <= kMaxThreadSlots; ++i) {
+		BX_DELETE(m_Allocator, m_Shards[i]);
+	}
+	BX_DELETE(m_Allocator, m_Drained);
+}
+
+template<uint32_t PrecisionBits>
+inline void concurrent_histogram<PrecisionBits>::record(uint64_t value, uint64_t count)
+{
+	const uint32_t slot = getThreadSlot();
+
+	histogram_type* shard = m_Shards[slot];
+	if (BX_UNLIKELY(!shard)) {
+		shard = createShard(slot);
+	}
+
+	if (slot == kMaxThreadSlots) {
+		sharedShardLock(&m_SharedLock);
+		recordShard(shard, value, count);
+		sharedShardUnlock(&m_SharedLock);
+	} else {
+		recordShard(shard, value, count);
+	}
+}
+
+// Same as histogram::record() with atomic stores, since readers merge the shard
+// concurrently.
+template<uint32_t PrecisionBits>
+inline void concurrent_histogram<PrecisionBits>::recordShard(histogram_type* shard, uint64_t value, uint64_t count)
+{
+	const uint32_t bucket = histogram_type::getBucketIndex(value);
+	atomicStore(&shard->m_Counts[bucket], shard->m_Counts[bucket] + count);
+	if (value < shard->m_Min) {
+		atomicStore(&shard->m_Min, value);
+	}
+	if (value > shard->m_Max) {
+		atomicStore(&shard->m_Max, value);
+	}
+	atomicStore(&shard->m_Sum, shard->m_Sum + (double)value * (double)count);
+	atomicStore(&shard->m_Count, shard->m_Count + count);
+}
+
+// Same as histogram::merge() with atomic loads. The count is taken from the buckets so
+// that it's always consistent with them (quantile queries rely on it).
+template<uint32_t PrecisionBits>
+void concurrent_histogram<PrecisionBits>::mergeShard(histogram_type& snapshot, const histogram_type* shard)
+{
+	if (!atomicLoad(&shard->m_Count)) {
+		return;
+	}
+
+	uint64_t count = 0;
+	for (uint32_t i = 0; i < histogram_type::kNumBuckets; ++i) {
+		const uint64_t bucketCount = atomicLoad(&shard->m_Counts[i]);
+		snapshot.m_Counts[i] += bucketCount;
+		count += bucketCount;
+	}
+
+	const uint64_t minValue = atomicLoad(&shard->m_Min);
+	const uint64_t maxValue = atomicLoad(&shard->m_Max);
+	snapshot.m_Count += count;
+	snapshot.m_Sum += atomicLoad(&shard->m_Sum);
+	snapshot.m_Min = minValue < snapshot.m_Min ? minValue : snapshot.m_Min;
+	snapshot.m_Max = maxValue > snapshot.m_Max ? maxValue : snapshot.m_Max;
+}
+
+template<uint32_t PrecisionBits>
+void concurrent_histogram<PrecisionBits>::read(histogram_type& snapshot) const
+{
+	snapshot.reset();
+	for (uint32_t i = 0; i <= kMaxThreadSlots; ++i) {
+		const histogram_type* shard = atomicLoad(&m_Shards[i]);
+		if (shard) {
+			mergeShard(snapshot, shard);
+		}
+	}
+}
+
+template<uint32_t PrecisionBits>
+void concurrent_histogram<PrecisionBits>::drain(histogram_type& snapshot)
+{
+	if (!m_Drained) {
+		m_Drained = BX_NEW(m_Allocator, histogram_type);
+	}
+
+	// snapshot = totals - drained, drained = totals
+	read(snapshot);
+
+	histogram_type& drained = *m_Drained;
+	uint32_t first = histogram_type::kNumBuckets;
+	uint32_t last = 0;
+	for (uint32_t i = 0; i < histogram_type::kNumBuckets; ++i) {
+		const uint64_t total = snapshot.m_Counts[i];
+		snapshot.m_Counts[i] = total - drained.m_Counts[i];
+		drained.m_Counts[i] = total;
+
+		if (snapshot.m_Counts[i]) {
+			first = bx::min(first, i);
+			last = i;
+		}
+	}
+
+	const uint64_t count = snapshot.m_Count;
+	const double sum = snapshot.m_Sum;
+	snapshot.m_Count = count - drained.m_Count;
+	snapshot.m_Sum = snapshot.m_Count ? sum - drained.m_Sum : 0.0;
+	drained.m_Count = count;
+	drained.m_Sum = sum;
+
+	// The exact bounds of the interval aren't known, use those of the buckets.
+	if (snapshot.m_Count) {
+		snapshot.m_Min = bx::max(histogram_type::getBucketLowest(first), snapshot.m_Min);
+		snapshot.m_Max = bx::min(histogram_type::getBucketHighest(last), snapshot.m_Max);
+	} else {
+		snapshot.m_Min = UINT64_MAX;
+		snapshot.m_Max = 0;
+	}
+}
+
+template<uint32_t PrecisionBits>
+typename concurrent_histogram<PrecisionBits>::histogram_type* concurrent_histogram<PrecisionBits>::createShard(uint32_t slot)
+{
+	histogram_type* shard = BX_NEW(m_Allocator, histogram_type);
+
+	// Only the thread owning the slot creates its shard, except for the shared one.
+	if (slot == kMaxThreadSlots) {
+		histogram_type* prev = atomicCompareAndSwapPtr(&m_Shards[slot], (histogram_type*)nullptr, shard);
+		if (prev) {
+			BX_DELETE(m_Allocator, shard);
+			return prev;
+		}
+	} else {
+		atomicStore(&m_Shards[slot], shard);
+	}
+
+	return shard;
+}
+}
+
+#endif
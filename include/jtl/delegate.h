@@ -123,6 +123,8 @@ public:
 	} //operator()
 
 private:
+	template<typename U> friend class event;
+
 	delegate(void* anObject, typename delegate_base<RET(PARAMS...)>::stub_type aStub)
 	{
 		invocation.object = anObject;
@@ -0,0 +1,173 @@
+#ifndef JTL_EPOCH_H
+#define JTL_EPOCH_H
+
+#include <stdint.h>
+#include <bx/allocator.h>
+#include "jtl.h"
+#include "shared_ptr.h"
+
+#include <utility> // std::forward
+
+namespace jtl
+{
+struct EpochRecord;
+struct EpochCollector;
+
+// Intrusive node for objects retired to an epoch_domain. m_Reclaim is called with the
+// node once no thread can be accessing the object anymore.
+struct epoch_retired
+{
+	epoch_retired* m_Next;
+	void (*m_Reclaim)(epoch_retired* item);
+	uint32_t m_Epoch;
+};
+
+// Epoch-based reclamation. Threads accessing shared objects do it inside critical
+// sections (enter()/leave() or epoch_guard). Objects which have been unlinked from
+// shared structures are retire()d instead of being freed, and are reclaimed in batches
+// by collect() once every thread which might have seen them has left its critical
+// section. collect() can be called explicitly at safe points or by a background thread
+// (start()/stop()), which moves destruction off latency sensitive threads.
+//
+// The global epoch advances when all threads currently inside a critical section have
+// observed it, and objects retired in epoch E are reclaimed once the global epoch
+// reaches E + 2.
+//
+// Critical sections can be nested and must be short; a thread staying inside one blocks
+// all reclamation. At most kMaxDomains domains can exist at the same time (creating
+// more aborts), and a domain must outlive the threads which use it.
+class epoch_domain
+{
+public:
+	static const uint32_t kMaxDomains = 16;
+
+	epoch_domain(bx::AllocatorI* allocator = nullptr);
+	~epoch_domain();
+
+	void enter();
+	void leave();
+
+	// Can be called from any thread, inside or outside a critical section.
+	void retire(epoch_retired* item);
+
+	// Tries to advance the global epoch and reclaims everything that's safe to reclaim.
+	// Returns the number of reclaimed objects. Only one thread collects at a time;
+	// concurrent calls return 0 immediately.
+	uint32_t collect();
+
+	// Calls collect() every intervalMs milliseconds from a background thread.
+	void start(uint32_t intervalMs = 10);
+	void stop();
+
+private:
+	bx::AllocatorI* m_Allocator;
+	EpochRecord* m_Records;
+	epoch_retired* m_Retired; // Lock-free stack of newly retired objects
+	epoch_retired* m_Pending; // Retired objects waiting for the epoch to advance (collector only)
+	EpochCollector* m_Collector;
+	uint32_t m_Epoch;
+	int32_t m_Collecting;
+	uint32_t m_Slot;
+	uint32_t m_Generation;
+
+	EpochRecord* getRecord();
+	EpochRecord* acquireRecord();
+	bool tryAdvance(uint32_t& epoch);
+
+	friend struct EpochThreadState;
+
+	epoch_domain(const epoch_domain&) = delete;
+	epoch_domain& operator = (const epoch_domain&) = delete;
+};
+
+// Global domain. Never destroyed. Its background collector is started on first use, so
+// objects retired to it are reclaimed without explicit collect() calls.
+epoch_domain* getDefaultEpochDomain();
+
+// RAII critical section.
+class epoch_guard
+{
+public:
+	explicit epoch_guard(epoch_domain* domain = nullptr);
+	~epoch_guard();
+
+private:
+	epoch_domain* m_Domain;
+
+	epoch_guard(const epoch_guard&) = delete;
+	epoch_guard& operator = (const epoch_guard&) = delete;
+};
+
+// shared_ptr control block which retires the object to an epoch_domain when the last
+// strong reference goes away, instead of destroying it on the releasing thread. The
+// object is destroyed (and the block freed, if there are no weak references left) when
+// the domain reclaims it.
+template<typename T>
+struct RefCountDeferred : public RefCount<T>, public epoch_retired
+{
+	epoch_domain* m_Domain;
+
+	template<typename... Args>
+	RefCountDeferred(epoch_domain* domain, bx::AllocatorI* allocator, Args&&... args)
+		: RefCount<T>(allocator, std::forward<Args>(args)...)
+		, m_Domain(domain)
+	{
+		this->m_Reclaim = reclaim;
+	}
+
+	virtual void destroy()
+	{
+		// Keep the block alive until the object has been reclaimed.
+		this->addWeakRef();
+		m_Domain->retire(this);
+	}
+
+	virtual void deallocate()
+	{
+		bx::AllocatorI* allocator = this->m_Allocator;
+		this->~RefCountDeferred();
+		BX_FREE(allocator, this);
+	}
+
+	static void reclaim(epoch_retired* item)
+	{
+		RefCountDeferred* refCount = static_cast<RefCountDeferred*>(item);
+		refCount->getObject()->~T();
+		refCount->releaseWeak();
+	}
+};
+
+template<typename T, typename... Args>
+inline shared_ptr<T> allocate_deferred_shared(epoch_domain* domain, bx::AllocatorI* allocator, Args&&... args)
+{
+	typedef RefCountDeferred<T> RefCountT;
+
+	shared_ptr<T> ret;
+	void* mem = BX_ALLOC(allocator, sizeof(RefCountT));
+	if (mem) {
+		RefCountT* refCount = BX_PLACEMENT_NEW(mem, RefCountT)(domain, allocator, std::forward<Args>(args)...);
+		allocate_shared_helper(ret, refCount, refCount->getObject());
+	}
+
+	return ret;
+}
+
+template<typename T, typename... Args>
+inline shared_ptr<T> make_deferred_shared(Args&&... args)
+{
+	return allocate_deferred_shared<T>(getDefaultEpochDomain(), getDefaultAllocator(), std::forward<Args>(args)...);
+}
+
+inline epoch_guard::epoch_guard(epoch_domain* domain)
+	: m_Domain(domain ? domain : getDefaultEpochDomain())
+{
+	m_Domain->enter();
+}
+
+inline epoch_guard::~epoch_guard()
+{
+	m_Domain->leave();
+}
+}
+
+#endif
@@ -0,0 +1,368 @@
+#ifndef JTL_EVENT_H
+#define JTL_EVENT_H
+
+#include <stdint.h>
+#include <bx/allocator.h>
+#include "jtl.h"
+#include "atomic.h"
+#include "delegate.h"
+#include "epoch.h"
+#include "vector.h"
+
+#include <mutex>
+
+namespace jtl
+{
+// Identifies a subscription. Default constructed handles are invalid.
+struct event_handle
+{
+	uint32_t m_Slot;
+	uint32_t m_Generation;
+
+	event_handle()
+		: m_Slot(0)
+		, m_Generation(0)
+	{
+	}
+
+	bool isValid() const
+	{
+		return m_Generation != 0;
+	}
+};
+
+template<typename T>
+class event;
+
+// Multicast delegate. Subscribers are kept in a contiguous array of invocation elements
+// (object + stub, like delegate) which is replaced as a whole on every change (copy on
+// write), so invocation doesn't take any locks: it reads the current array inside an
+// epoch critical section and calls every element. Replaced arrays are retired to the
+// epoch domain and freed when it collects. The default domain has a background
+// collector; with a domain which doesn't, its owner must call collect() (e.g. once per
+// frame), otherwise replaced arrays accumulate.
+//
+// Subscribing and unsubscribing serialize on a mutex and cost a copy of the array. The
+// handle is resolved to the array position in O(1) and the last element is moved into
+// the removed one, so the call order isn't preserved. Callbacks can (un)subscribe while
+// the event is being invoked; the invocation in progress keeps using the old array.
+//
+// Like delegate, lambdas and objects are referenced, not copied, so they must outlive
+// their subscription. Return values of the subscribers are ignored.
+template<typename RET, typename ...PARAMS>
+class event<RET(PARAMS...)> : private delegate_base<RET(PARAMS...)>
+{
+	typedef typename delegate_base<RET(PARAMS...)>::InvocationElement InvocationElement;
+
+	struct Snapshot;
+
+public:
+	typedef delegate<RET(PARAMS...)> delegate_type;
+
+	// Invokes the event multiple times using the same snapshot of the subscribers and a
+	// single critical section, e.g. when firing a burst of events from a loop.
+	// Subscription changes made while the batch is alive are only visible to later
+	// batches.
+	class batch
+	{
+	public:
+		explicit batch(const event& evt);
+
+		void operator()(PARAMS... params) const;
+
+	private:
+		epoch_guard m_Guard;
+		const Snapshot* m_Snapshot;
+
+		batch(const batch&) = delete;
+		batch& operator = (const batch&) = delete;
+	};
+
+	event(epoch_domain* domain = nullptr, bx::AllocatorI* allocator = nullptr);
+	~event();
+
+	event_handle subscribe(const delegate_type& func);
+
+	template<class T, RET(T::*TMethod)(PARAMS...)>
+	event_handle subscribe(T* instance);
+
+	template<class T, RET(T::*TMethod)(PARAMS...) const>
+	event_handle subscribe(T const* instance);
+
+	template<RET(*TMethod)(PARAMS...)>
+	event_handle subscribe();
+
+	template<typename LAMBDA>
+	event_handle subscribe(const LAMBDA& lambda);
+
+	// Returns false if the handle has already been unsubscribed.
+	bool unsubscribe(event_handle handle);
+	void clear();
+
+	uint32_t size() const;
+	bool empty() const;
+
+	void operator()(PARAMS... params) const;
+
+private:
+	struct Snapshot : public epoch_retired
+	{
+		bx::AllocatorI* m_Allocator;
+		uint32_t m_Count;
+
+		InvocationElement* getElements()
+		{
+			return (InvocationElement*)(this + 1);
+		}
+
+		const InvocationElement* getElements() const
+		{
+			return (const InvocationElement*)(this + 1);
+		}
+	};
+
+	struct Slot
+	{
+		uint32_t m_Generation; // Even when the slot is free
+		uint32_t m_Position;
+	};
+
+	epoch_domain* m_Domain;
+	bx::AllocatorI* m_Allocator;
+	Snapshot* m_Snapshot;
+	std::mutex m_Mutex;
+	vector<Slot> m_Slots;
+	vector<uint32_t> m_FreeSlots;
+	vector<uint32_t> m_SlotByPosition;
+
+	Snapshot* createSnapshot(uint32_t count);
+	void publish(Snapshot* snapshot);
+
+	static void invoke(const Snapshot* snapshot, PARAMS... params);
+	static void reclaim(epoch_retired* item);
+
+	event(const event&) = delete;
+	event& operator = (const event&) = delete;
+};
+
+template<typename RET, typename ...PARAMS>
+inline event<RET(PARAMS...)>::batch::batch(const event& evt)
+	: m_Guard(evt.m_Domain)
+	, m_Snapshot(atomicLoad(&evt.m_Snapshot))
+{
+}
+
+template<typename RET, typename ...PARAMS>
+inline void event<RET(PARAMS...)>::batch::operator()(PARAMS... params) const
+{
+	if (m_Snapshot) {
+		invoke(m_Snapshot, params...);
+	}
+}
+
+template<typename RET, typename ...PARAMS>
+inline event<RET(PARAMS...)>::event(epoch_domain* domain, bx::AllocatorI* allocator)
+	: m_Domain(domain ? domain : getDefaultEpochDomain())
+	, m_Allocator(allocator ? allocator : getDefaultAllocator())
+	, m_Snapshot(nullptr)
+{
+}
+
+template<typename RET, typename ...PARAMS>
+inline event<RET(PARAMS...)>::~event()
+{
+	clear();
+}
+
+template<typename RET, typename ...PARAMS>
+inline event_handle event<RET(PARAMS...)>::subscribe(const delegate_type& func)
+{
+	JTL_CHECK(!func.isNull(), "Subscribing a null delegate");
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	uint32_t slot;
+	if (!m_FreeSlots.empty()) {
+		slot = m_FreeSlots[m_FreeSlots.size() - 1];
+		m_FreeSlots.pop_back();
+	} else {
+		slot = m_Slots.size();
+		Slot newSlot;
+		newSlot.m_Generation = 0;
+		newSlot.m_Position = 0;
+		m_Slots.push_back(newSlot);
+	}
+
+	const Snapshot* cur = m_Snapshot;
+	const uint32_t count = cur ? cur->m_Count : 0;
+
+	Snapshot* snapshot = createSnapshot(count + 1);
+	if (count) {
+		bx::memCopy(snapshot->getElements(), cur->getElements(), sizeof(InvocationElement) * count);
+	}
+	func.invocation.Clone(snapshot->getElements()[count]);
+
+	Slot& s = m_Slots[slot];
+	s.m_Generation++;
+	s.m_Position = count;
+	m_SlotByPosition.push_back(slot);
+
+	publish(snapshot);
+
+	event_handle handle;
+	handle.m_Slot = slot;
+	handle.m_Generation = s.m_Generation;
+	return handle;
+}
+
+template<typename RET, typename ...PARAMS>
+template<class T, RET(T::*TMethod)(PARAMS...)>
+inline event_handle event<RET(PARAMS...)>::subscribe(T* instance)
+{
+	return subscribe(delegate_type::template create<T, TMethod>(instance));
+}
+
+template<typename RET, typename ...PARAMS>
+template<class T, RET(T::*TMethod)(PARAMS...) const>
+inline event_handle event<RET(PARAMS...)>::subscribe(T const* instance)
+{
+	return subscribe(delegate_type::template create<T, TMethod>(instance));
+}
+
+template<typename RET, typename ...PARAMS>
+template<RET(*TMethod)(PARAMS...)>
+inline event_handle event<RET(PARAMS...)>::subscribe()
+{
+	return subscribe(delegate_type::template create<TMethod>());
+}
+
+template<typename RET, typename ...PARAMS>
+template<typename LAMBDA>
+inline event_handle event<RET(PARAMS...)>::subscribe(const LAMBDA& lambda)
+{
+	return subscribe(delegate_type::create(lambda));
+}
+
+template<typename RET, typename ...PARAMS>
+inline bool event<RET(PARAMS...)>::unsubscribe(event_handle handle)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	if (!handle.isValid() || handle.m_Slot >= m_Slots.size() || m_Slots[handle.m_Slot].m_Generation != handle.m_Generation) {
+		return false;
+	}
+
+	Slot& s = m_Slots[handle.m_Slot];
+	const uint32_t pos = s.m_Position;
+	s.m_Generation++;
+	m_FreeSlots.push_back(handle.m_Slot);
+
+	const Snapshot* cur = m_Snapshot;
+	const uint32_t last = cur->m_Count - 1;
+
+	Snapshot* snapshot = nullptr;
+	if (last) {
+		snapshot = createSnapshot(last);
+		bx::memCopy(snapshot->getElements(), cur->getElements(), sizeof(InvocationElement) * last);
+		if (pos != last) {
+			snapshot->getElements()[pos] = cur->getElements()[last];
+
+			const uint32_t movedSlot = m_SlotByPosition[last];
+			m_SlotByPosition[pos] = movedSlot;
+			m_Slots[movedSlot].m_Position = pos;
+		}
+	}
+	m_SlotByPosition.pop_back();
+
+	publish(snapshot);
+
+	return true;
+}
+
+template<typename RET, typename ...PARAMS>
+inline void event<RET(PARAMS...)>::clear()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	for (uint32_t i = 0; i < m_SlotByPosition.size(); ++i) {
+		const uint32_t slot = m_SlotByPosition[i];
+		m_Slots[slot].m_Generation++;
+		m_FreeSlots.push_back(slot);
+	}
+	m_SlotByPosition.clear();
+
+	publish(nullptr);
+}
+
+template<typename RET, typename ...PARAMS>
+inline uint32_t event<RET(PARAMS...)>::size() const
+{
+	epoch_guard guard(m_Domain);
+	const Snapshot* snapshot = atomicLoad(&m_Snapshot);
+	return snapshot ? snapshot->m_Count : 0;
+}
+
+template<typename RET, typename ...PARAMS>
+inline bool event<RET(PARAMS...)>::empty() const
+{
+	return atomicLoad(&m_Snapshot) == nullptr;
+}
+
+template<typename RET, typename ...PARAMS>
+inline void event<RET(PARAMS...)>::operator()(PARAMS... params) const
+{
+	// Don't pay for the critical section when nobody is listening.
+	if (!atomicLoad(&m_Snapshot)) {
+		return;
+	}
+
+	epoch_guard guard(m_Domain);
+	const Snapshot* snapshot = atomicLoad(&m_Snapshot);
+	if (snapshot) {
+		invoke(snapshot, params...);
+	}
+}
+
+template<typename RET, typename ...PARAMS>
+inline typename event<RET(PARAMS...)>::Snapshot* event<RET(PARAMS...)>::createSnapshot(uint32_t count)
+{
+	Snapshot* snapshot = (Snapshot*)BX_ALLOC(m_Allocator, sizeof(Snapshot) + sizeof(InvocationElement) * count);
+	JTL_CHECK(snapshot, "Allocation failed");
+	snapshot->m_Next = nullptr;
+	snapshot->m_Reclaim = reclaim;
+	snapshot->m_Epoch = 0;
+	snapshot->m_Allocator = m_Allocator;
+	snapshot->m_Count = count;
+	return snapshot;
+}
+
+// Called with the mutex held.
+template<typename RET, typename ...PARAMS>
+inline void event<RET(PARAMS...)>::publish(Snapshot* snapshot)
+{
+	Snapshot* prev = m_Snapshot;
+	atomicStore(&m_Snapshot, snapshot);
+	if (prev) {
+		m_Domain->retire(prev);
+	}
+}
+
+template<typename RET, typename ...PARAMS>
+inline void event<RET(PARAMS...)>::invoke(const Snapshot* snapshot, PARAMS... params)
+{
+	const InvocationElement* elements = snapshot->getElements();
+	const uint32_t count = snapshot->m_Count;
+	for (uint32_t i = 0; i < count; ++i) {
+		(*elements[i].stub)(elements[i].object, params...);
+	}
+}
+
+template<typename RET, typename ...PARAMS>
+inline void event<RET(PARAMS...)>::reclaim(epoch_retired* item)
+{
+	Snapshot* snapshot = static_cast<Snapshot*>(item);
+	BX_FREE(snapshot->m_Allocator, snapshot);
+}
+}
+
+#endif
@@ -0,0 +1,511 @@
+#ifndef JTL_FUTURE_H
+#define JTL_FUTURE_H
+
+#include <stdint.h>
+#include <bx/allocator.h>
+#include "jtl.h"
+#include "atomic.h"
+#include "scheduler.h"
+#include "pool_allocator.h"
+
+#include <utility> // std::forward, std::move, std::declval
+#include <type_traits> // std::aligned_storage, std::decay
+
+namespace jtl
+{
+template<typename T>
+class future;
+
+template<typename T>
+class promise;
+
+template<typename T>
+struct FutureAwaiter;
+
+struct FutureCombinator;
+
+// Shared state of a promise/future pair. Completion is lock-free: the value is
+// constructed first and then m_Continuation is exchanged with kFutureReady. Whoever
+// installs a continuation after that finds the state ready and dispatches it directly,
+// otherwise the completing thread dispatches it.
+struct FutureStateBase
+{
+	scheduler_task* m_Continuation; // nullptr, kFutureReady or the continuation to dispatch on completion
+	scheduler* m_Scheduler; // Scheduler to run the continuation on, nullptr runs it inline
+	bx::AllocatorI* m_Allocator;
+	void (*m_Destroy)(FutureStateBase* state);
+	int32_t m_RefCount;
+};
+
+static scheduler_task* const kFutureReady = (scheduler_task*)(uintptr_t)1;
+
+// Marks the state as ready and dispatches its continuation, if any.
+void futureComplete(FutureStateBase* state);
+
+// Installs the (single) continuation of the state. It's dispatched immediately if the
+// state is already ready.
+void futureAttach(FutureStateBase* state, scheduler_task* continuation, scheduler* sched);
+
+// Waits for the state to become ready. Worker threads run other tasks in the meantime,
+// other threads block.
+void futureWait(FutureStateBase* state);
+
+FutureCombinator* createWhenAll(uint32_t count, future<void>& result);
+FutureCombinator* createWhenAny(uint32_t count, future<uint32_t>& result);
+void attachCombinator(FutureCombinator* combinator, uint32_t index, FutureStateBase* state);
+
+inline bool futureIsReady(const FutureStateBase* state)
+{
+	return atomicLoad(&state->m_Continuation) == kFutureReady;
+}
+
+inline void futureAddRef(FutureStateBase* state)
+{
+	bx::atomicFetchAndAdd<int32_t>(&state->m_RefCount, 1);
+}
+
+inline void futureRelease(FutureStateBase* state)
+{
+	if (bx::atomicSubAndFetch<int32_t>(&state->m_RefCount, 1) == 0) {
+		state->m_Destroy(state);
+	}
+}
+
+template<typename T>
+struct FutureState : public FutureStateBase
+{
+	typename std::aligned_storage<sizeof(T), alignof(T)>::type m_Value;
+
+	T* getValue()
+	{
+		return (T*)&m_Value;
+	}
+
+	template<typename... Args>
+	void emplace(Args&&... args)
+	{
+		BX_PLACEMENT_NEW(getValue(), T)(std::forward<Args>(args)...);
+	}
+
+	T take()
+	{
+		return std::move(*getValue());
+	}
+
+	static void destroy(FutureStateBase* base)
+	{
+		FutureState* state = static_cast<FutureState*>(base);
+		if (futureIsReady(state)) {
+			state->getValue()->~T();
+		}
+
+		BX_FREE(state->m_Allocator, state);
+	}
+};
+
+template<>
+struct FutureState<void> : public FutureStateBase
+{
+	void emplace()
+	{
+	}
+
+	void take()
+	{
+	}
+
+	static void destroy(FutureStateBase* base)
+	{
+		BX_FREE(base->m_Allocator, base);
+	}
+};
+
+// Releases a state reference when going out of scope, after the return value of the
+// function has been constructed.
+struct FutureStateRef
+{
+	FutureStateBase* m_State;
+
+	explicit FutureStateRef(FutureStateBase* state)
+		: m_State(state)
+	{
+	}
+
+	~FutureStateRef()
+	{
+		futureRelease(m_State);
+	}
+};
+
+// Return type of the continuation (std::result_of is gone in C++20 and std::invoke_result
+// needs C++17).
+template<typename F, typename T>
+struct FutureResult
+{
+	typedef decltype(std::declval<F>()(std::declval<T>())) type;
+};
+
+template<typename F>
+struct FutureResult<F, void>
+{
+	typedef decltype(std::declval<F>()()) type;
+};
+
+// Producer side of a future. The shared state is allocated from the pool allocator by
+// default. set_value() must be called exactly once, otherwise the future never becomes
+// ready.
+template<typename T>
+class promise
+{
+public:
+	explicit promise(bx::AllocatorI* allocator = nullptr);
+	promise(promise&& other);
+	~promise();
+
+	promise& operator = (promise&& other);
+
+	// Can be called only once.
+	future<T> get_future();
+
+	template<typename... Args>
+	void set_value(Args&&... args);
+
+private:
+	FutureState<T>* m_State;
+	bool m_FutureRetrieved;
+
+	promise(const promise&) = delete;
+	promise& operator = (const promise&) = delete;
+};
+
+// Lightweight replacement for std::future. Waiting doesn't take any locks on worker
+// threads and continuations are chained with then() instead of blocking a thread.
+//
+// A future supports a single continuation: then(), when_all()/when_any() and a blocking
+// wait()/get() on a future which isn't ready yet all install one, so only one of them
+// can be used while the future is pending. The value can be retrieved with get() once
+// when_all()/when_any() has completed, since the future is ready by then.
+template<typename T>
+class future
+{
+public:
+	future();
+	future(future&& other);
+	~future();
+
+	future& operator = (future&& other);
+
+	bool valid() const;
+	bool is_ready() const;
+	void wait() const;
+
+	// Waits for the value and moves it out. The future is invalid afterwards.
+	T get();
+
+	// Calls func with the value on sched (the default scheduler if nullptr) once it's
+	// ready and returns a future for its result. The future is invalid afterwards.
+	template<typename FUNC>
+	future<typename FutureResult<typename std::decay<FUNC>::type, T>::type> then(FUNC&& func, scheduler* sched = nullptr);
+
+private:
+	template<typename U> friend class promise;
+	template<typename U> friend struct FutureAwaiter;
+	template<typename U> friend future<void> when_all(future<U>* futures, uint32_t count);
+	template<typename U> friend future<uint32_t> when_any(future<U>* futures, uint32_t count);
+
+	FutureState<T>* m_State;
+
+	explicit future(FutureState<T>* state);
+
+	future(const future&) = delete;
+	future& operator = (const future&) = delete;
+};
+
+// Calls f and stores its result in the promise.
+template<typename R>
+struct FutureApply
+{
+	template<typename F, typename... Args>
+	static void apply(promise<R>& p, F& f, Args&&... args)
+	{
+		p.set_value(f(std::forward<Args>(args)...));
+	}
+};
+
+template<>
+struct FutureApply<void>
+{
+	template<typename F, typename... Args>
+	static void apply(promise<void>& p, F& f, Args&&... args)
+	{
+		f(std::forward<Args>(args)...);
+		p.set_value();
+	}
+};
+
+// Calls f with the value of the (ready) source future and stores its result in the
+// promise.
+template<typename T>
+struct FutureContinue
+{
+	template<typename R, typename F>
+	static void apply(promise<R>& p, F& f, future<T>& src)
+	{
+		FutureApply<R>::apply(p, f, src.get());
+	}
+};
+
+template<>
+struct FutureContinue<void>
+{
+	template<typename R, typename F>
+	static void apply(promise<R>& p, F& f, future<void>& src)
+	{
+		src.get();
+		FutureApply<R>::apply(p, f);
+	}
+};
+
+template<typename T, typename FUNC, typename R>
+struct FutureThenTask : public scheduler_task
+{
+	bx::AllocatorI* m_Allocator;
+	future<T> m_Source;
+	promise<R> m_Promise;
+	FUNC m_Func;
+
+	template<typename F>
+	FutureThenTask(bx::AllocatorI* allocator, future<T>&& source, F&& func)
+		: m_Allocator(allocator)
+		, m_Source(std::move(source))
+		, m_Promise()
+		, m_Func(std::forward<F>(func))
+	{
+		m_Next = nullptr;
+		m_Execute = execute;
+	}
+
+	static void execute(scheduler_task* task)
+	{
+		FutureThenTask* self = static_cast<FutureThenTask*>(task);
+		FutureContinue<T>::apply(self->m_Promise, self->m_Func, self->m_Source);
+
+		bx::AllocatorI* allocator = self->m_Allocator;
+		BX_DELETE(allocator, self);
+	}
+};
+
+// Returns a future which becomes ready when all the futures are ready. The futures must
+// stay alive (or be moved-from) until then.
+template<typename T>
+future<void> when_all(future<T>* futures, uint32_t count);
+
+// Returns a future for the index of the first future which becomes ready. The futures
+// must stay alive until all of them are ready.
+template<typename T>
+future<uint32_t> when_any(future<T>* futures, uint32_t count);
+
+template<typename T, typename... Args>
+future<T> make_ready_future(Args&&... args);
+
+template<typename T>
+inline promise<T>::promise(bx::AllocatorI* allocator)
+	: m_State(nullptr)
+	, m_FutureRetrieved(false)
+{
+	allocator = allocator ? allocator : getPoolAllocator();
+	m_State = (FutureState<T>*)BX_ALLOC(allocator, sizeof(FutureState<T>));
+	JTL_CHECK(m_State, "Allocation failed");
+	m_State->m_Continuation = nullptr;
+	m_State->m_Scheduler = nullptr;
+	m_State->m_Allocator = allocator;
+	m_State->m_Destroy = FutureState<T>::destroy;
+	m_State->m_RefCount = 1;
+}
+
+template<typename T>
+inline promise<T>::promise(promise&& other)
+	: m_State(other.m_State)
+	, m_FutureRetrieved(other.m_FutureRetrieved)
+{
+	other.m_State = nullptr;
+}
+
+template<typename T>
+inline promise<T>::~promise()
+{
+	if (m_State) {
+		JTL_CHECK(futureIsReady(m_State), "Promise destroyed without setting a value");
+		futureRelease(m_State);
+	}
+}
+
+template<typename T>
+inline promise<T>& promise<T>::operator = (promise&& other)
+{
+	if (&other != this) {
+		if (m_State) {
+			JTL_CHECK(futureIsReady(m_State), "Promise destroyed without setting a value");
+			futureRelease(m_State);
+		}
+
+		m_State = other.m_State;
+		m_FutureRetrieved = other.m_FutureRetrieved;
+		other.m_State = nullptr;
+	}
+
+	return *this;
+}
+
+template<typename T>
+inline future<T> promise<T>::get_future()
+{
+	JTL_CHECK(m_State && !m_FutureRetrieved, "Future already retrieved");
+	m_FutureRetrieved = true;
+	futureAddRef(m_State);
+	return future<T>(m_State);
+}
+
+template<typename T>
+template<typename... Args>
+inline void promise<T>::set_value(Args&&... args)
+{
+	JTL_CHECK(m_State && !futureIsReady(m_State), "Value already set");
+	m_State->emplace(std::forward<Args>(args)...);
+	futureComplete(m_State);
+}
+
+template<typename T>
+inline future<T>::future()
+	: m_State(nullptr)
+{
+}
+
+template<typename T>
+inline future<T>::future(FutureState<T>* state)
+	: m_State(state)
+{
+}
+
+template<typename T>
+inline future<T>::future(future&& other)
+	: m_State(other.m_State)
+{
+	other.m_State = nullptr;
+}
+
+template<typename T>
+inline future<T>::~future()
+{
+	if (m_State) {
+		futureRelease(m_State);
+	}
+}
+
+template<typename T>
+inline future<T>& future<T>::operator = (future&& other)
+{
+	if (&other != this) {
+		if (m_State) {
+			futureRelease(m_State);
+		}
+
+		m_State = other.m_State;
+		other.m_State = nullptr;
+	}
+
+	return *this;
+}
+
+template<typename T>
+inline bool future<T>::valid() const
+{
+	return m_State != nullptr;
+}
+
+template<typename T>
+inline bool future<T>::is_ready() const
+{
+	return m_State && futureIsReady(m_State);
+}
+
+template<typename T>
+inline void future<T>::wait() const
+{
+	JTL_CHECK(m_State, "Waiting on an invalid future");
+	if (!futureIsReady(m_State)) {
+		futureWait(m_State);
+	}
+}
+
+template<typename T>
+inline T future<T>::get()
+{
+	wait();
+
+	FutureStateRef ref(m_State);
+	FutureState<T>* state = m_State;
+	m_State = nullptr;
+	return state->take();
+}
+
+template<typename T>
+template<typename FUNC>
+inline future<typename FutureResult<typename std::decay<FUNC>::type, T>::type> future<T>::then(FUNC&& func, scheduler* sched)
+{
+	typedef typename std::decay<FUNC>::type FuncT;
+	typedef typename FutureResult<FuncT, T>::type R;
+	typedef FutureThenTask<T, FuncT, R> TaskT;
+
+	JTL_CHECK(m_State, "Continuing an invalid future");
+	sched = sched ? sched : getDefaultScheduler();
+
+	bx::AllocatorI* allocator = sched->getAllocator();
+	void* mem = BX_ALLOC(allocator, sizeof(TaskT));
+	JTL_CHECK(mem, "Allocation failed");
+
+	FutureState<T>* state = m_State;
+	TaskT* task = BX_PLACEMENT_NEW(mem, TaskT)(allocator, std::move(*this), std::forward<FUNC>(func));
+	future<R> ret = task->m_Promise.get_future();
+	futureAttach(state, task, sched);
+	return ret;
+}
+
+template<typename T>
+inline future<void> when_all(future<T>* futures, uint32_t count)
+{
+	future<void> ret;
+	FutureCombinator* combinator = createWhenAll(count, ret);
+	for (uint32_t i = 0; i < count; ++i) {
+		JTL_CHECK(futures[i].m_State, "Invalid future");
+		attachCombinator(combinator, i, futures[i].m_State);
+	}
+
+	return ret;
+}
+
+template<typename T>
+inline future<uint32_t> when_any(future<T>* futures, uint32_t count)
+{
+	JTL_CHECK(count != 0, "when_any() needs at least one future");
+
+	future<uint32_t> ret;
+	FutureCombinator* combinator = createWhenAny(count, ret);
+	for (uint32_t i = 0; i < count; ++i) {
+		JTL_CHECK(futures[i].m_State, "Invalid future");
+		attachCombinator(combinator, i, futures[i].m_State);
+	}
+
+	return ret;
+}
+
+template<typename T, typename... Args>
+inline future<T> make_ready_future(Args&&... args)
+{
+	promise<T> p;
+	p.set_value(std::forward<Args>(args)...);
+	return p.get_future();
+}
+}
+
+#endif
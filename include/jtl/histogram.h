@@ -0,0 +1,318 @@
+#ifndef JTL_HISTOGRAM_H
+#define JTL_HISTOGRAM_H
+
+#include <stdint.h>
+#include <bx/bx.h>
+#include <bx/math.h>
+#include "jtl.h"
+
+namespace jtl
+{
+// Log-linear (HDR style) histogram of uint64_t values, e.g. latencies in nanoseconds.
+// Every power of two range is split into 2^PrecisionBits linear buckets, so reported
+// quantiles are within 2^-PrecisionBits of the recorded values (~0.8% with the default
+// 7 bits) over the whole uint64_t range. record() is O(1) and never allocates; the
+// bucket counts are stored inline ((65 - PrecisionBits) * 2^PrecisionBits counters,
+// ~58KB with the default precision), so avoid putting histograms on the stack.
+//
+// Histograms with the same precision can be merged, e.g. to combine per-thread
+// histograms or the slices of a windowed_histogram.
+template<uint32_t PrecisionBits = 7>
+class histogram
+{
+public:
+	static const uint32_t kNumSubBuckets = 1u << PrecisionBits;
+	static const uint32_t kNumBuckets = (65 - PrecisionBits) << PrecisionBits;
+
+	histogram();
+	~histogram();
+
+	void record(uint64_t value, uint64_t count = 1);
+	void merge(const histogram& other);
+	void reset();
+
+	uint64_t getCount() const;
+	uint64_t getMin() const;
+	uint64_t getMax() const;
+	double getMean() const;
+
+	// Returns the value below which percentile% (0..100) of the recorded values fall.
+	uint64_t getPercentile(double percentile) const;
+
+	// Same as getPercentile() for numPercentiles values, in a single pass. percentiles
+	// must be sorted in increasing order.
+	void getPercentiles(const double* percentiles, uint64_t* values, uint32_t numPercentiles) const;
+
+	static uint32_t getBucketIndex(uint64_t value);
+	static uint64_t getBucketLowest(uint32_t bucket);
+	static uint64_t getBucketHighest(uint32_t bucket);
+
+private:
+	template<uint32_t P, uint32_t S>
+	friend class windowed_histogram;
+
+	template<uint32_t P>
+	friend class concurrent_histogram;
+
+	uint64_t m_Counts[kNumBuckets];
+	uint64_t m_Count;
+	uint64_t m_Min;
+	uint64_t m_Max;
+	double m_Sum;
+
+	void subtract(const histogram& other);
+	uint64_t getBucketValue(uint32_t bucket) const;
+};
+
+// Histogram over a sliding window made of NumSlices rotating sub-histograms. Values are
+// recorded into the current slice and into a running total of all the slices; rotate()
+// (e.g. called once per second by the owner) drops the oldest slice from the total and
+// makes it the current one, so the window covers the last NumSlices rotation periods.
+// record() is O(1), rotate() is O(number of buckets), and the queries are those of a
+// regular histogram on getWindow().
+template<uint32_t PrecisionBits = 7, uint32_t NumSlices = 8>
+class windowed_histogram
+{
+public:
+	windowed_histogram();
+	~windowed_histogram();
+
+	void record(uint64_t value, uint64_t count = 1);
+	void rotate();
+	void reset();
+
+	const histogram<PrecisionBits>& getWindow() const;
+	const histogram<PrecisionBits>& getCurrentSlice() const;
+
+private:
+	histogram<PrecisionBits> m_Slices[NumSlices];
+	histogram<PrecisionBits> m_Window;
+	uint32_t m_Current;
+};
+
+template<uint32_t PrecisionBits>
+inline uint32_t histogram<PrecisionBits>::getBucketIndex(uint64_t value)
+{
+	// Values below 2^(PrecisionBits + 1) have their own bucket; above that, the value is
+	// shifted so that its PrecisionBits + 1 most significant bits select the bucket.
+	const uint32_t msb = 63 - (uint32_t)bx::uint64_cntlz(value | 1);
+	const uint32_t shift = msb > PrecisionBits ? msb - PrecisionBits : 0;
+	return (shift << PrecisionBits) + (uint32_t)(value >> shift);
+}
+
+template<uint32_t PrecisionBits>
+inline uint64_t histogram<PrecisionBits>::getBucketLowest(uint32_t bucket)
+{
+	const uint32_t group = bucket >> PrecisionBits;
+	if (group <= 1) {
+		return bucket;
+	}
+
+	const uint32_t shift = group - 1;
+	return (uint64_t)(bucket - (shift << PrecisionBits)) << shift;
+}
+
+template<uint32_t PrecisionBits>
+inline uint64_t histogram<PrecisionBits>::getBucketHighest(uint32_t bucket)
+{
+	const uint32_t group = bucket >> PrecisionBits;
+	if (group <= 1) {
+		return bucket;
+	}
+
+	const uint32_t shift = group - 1;
+	return getBucketLowest(bucket) + ((1ull << shift) - 1);
+}
+
+template<uint32_t PrecisionBits>
+histogram<PrecisionBits>::histogram()
+{
+	reset();
+}
+
+template<uint32_t PrecisionBits>
+histogram<PrecisionBits>::~histogram()
+{
+}
+
+template<uint32_t PrecisionBits>
+inline void histogram<PrecisionBits>::record(uint64_t value, uint64_t count)
+{
+	m_Counts[getBucketIndex(value)] += count;
+	m_Count += count;
+	m_Sum += (double)value * (double)count;
+	m_Min = value < m_Min ? value : m_Min;
+	m_Max = value > m_Max ? value : m_Max;
+}
+
+template<uint32_t PrecisionBits>
+void histogram<PrecisionBits>::merge(const histogram& other)
+{
+	if (!other.m_Count) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < kNumBuckets; ++i) {
+		m_Counts[i] += other.m_Counts[i];
+	}
+
+	m_Count += other.m_Count;
+	m_Sum += other.m_Sum;
+	m_Min = other.m_Min < m_Min ? other.m_Min : m_Min;
+	m_Max = other.m_Max > m_Max ? other.m_Max : m_Max;
+}
+
+// Removes the counts of a histogram which has been merged into this one. The bounds
+// can't be updated and are left to the caller.
+template<uint32_t PrecisionBits>
+void histogram<PrecisionBits>::subtract(const histogram& other)
+{
+	if (!other.m_Count) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < kNumBuckets; ++i) {
+		m_Counts[i] -= other.m_Counts[i];
+	}
+
+	m_Count -= other.m_Count;
+	m_Sum = m_Count ? m_Sum - other.m_Sum : 0.0;
+}
+
+template<uint32_t PrecisionBits>
+void histogram<PrecisionBits>::reset()
+{
+	bx::memSet(m_Counts, 0, sizeof(m_Counts));
+	m_Count = 0;
+	m_Min = UINT64_MAX;
+	m_Max = 0;
+	m_Sum = 0.0;
+}
+
+template<uint32_t PrecisionBits>
+inline uint64_t histogram<PrecisionBits>::getCount() const
+{
+	return m_Count;
+}
+
+template<uint32_t PrecisionBits>
+inline uint64_t histogram<PrecisionBits>::getMin() const
+{
+	return m_Count ? m_Min : 0;
+}
+
+template<uint32_t PrecisionBits>
+inline uint64_t histogram<PrecisionBits>::getMax() const
+{
+	return m_Max;
+}
+
+template<uint32_t PrecisionBits>
+inline double histogram<PrecisionBits>::getMean() const
+{
+	return m_Count ? m_Sum / (double)m_Count : 0.0;
+}
+
+template<uint32_t PrecisionBits>
+uint64_t histogram<PrecisionBits>::getPercentile(double percentile) const
+{
+	uint64_t value;
+	getPercentiles(&percentile, &value, 1);
+	return value;
+}
+
+template<uint32_t PrecisionBits>
+void histogram<PrecisionBits>::getPercentiles(const double* percentiles, uint64_t* values, uint32_t numPercentiles) const
+{
+	uint32_t bucket = 0;
+	uint64_t total = 0;
+	for (uint32_t i = 0; i < numPercentiles; ++i) {
+		JTL_CHECK(i == 0 || percentiles[i - 1] <= percentiles[i], "Percentiles must be sorted");
+		if (!m_Count) {
+			values[i] = 0;
+			continue;
+		}
+
+		const double p = bx::clamp(percentiles[i], 0.0, 100.0);
+		uint64_t rank = (uint64_t)(p * 0.01 * (double)m_Count + 0.5);
+		rank = bx::clamp<uint64_t>(rank, 1, m_Count);
+
+		while (total + m_Counts[bucket] < rank) {
+			total += m_Counts[bucket];
+			++bucket;
+		}
+
+		values[i] = getBucketValue(bucket);
+	}
+}
+
+// Highest value of the bucket, clamped to the recorded bounds.
+template<uint32_t PrecisionBits>
+inline uint64_t histogram<PrecisionBits>::getBucketValue(uint32_t bucket) const
+{
+	const uint64_t value = getBucketHighest(bucket);
+	return bx::clamp(value, m_Min, m_Max);
+}
+
+template<uint32_t PrecisionBits, uint32_t NumSlices>
+windowed_histogram<PrecisionBits, NumSlices>::windowed_histogram() : m_Current(0)
+{
+}
+
+template<uint32_t PrecisionBits, uint32_t NumSlices>
+windowed_histogram<PrecisionBits, NumSlices>::~windowed_histogram()
+{
+}
+
+template<uint32_t PrecisionBits, uint32_t NumSlices>
+inline void windowed_histogram<PrecisionBits, NumSlices>::record(uint64_t value, uint64_t count)
+{
+	m_Slices[m_Current].record(value, count);
+	m_Window.record(value, count);
+}
+
+template<uint32_t PrecisionBits, uint32_t NumSlices>
+void windowed_histogram<PrecisionBits, NumSlices>::rotate()
+{
+	m_Current = (m_Current + 1) % NumSlices;
+
+	histogram<PrecisionBits>& oldest = m_Slices[m_Current];
+	m_Window.subtract(oldest);
+	oldest.reset();
+
+	// The bounds of the window are those of the remaining slices.
+	uint64_t minValue = UINT64_MAX;
+	uint64_t maxValue = 0;
+	for (uint32_t i = 0; i < NumSlices; ++i) {
+		const histogram<PrecisionBits>& slice = m_Slices[i];
+		minValue = slice.m_Min < minValue ? slice.m_Min : minValue;
+		maxValue = slice.m_Max > maxValue ? slice.m_Max : maxValue;
+	}
+	m_Window.m_Min = minValue;
+	m_Window.m_Max = maxValue;
+}
+
+template<uint32_t PrecisionBits, uint32_t NumSlices>
+void windowed_histogram<PrecisionBits, NumSlices>::reset()
+{
+	for (uint32_t i = 0; i < NumSlices; ++i) {
+		m_Slices[i].reset();
+	}
+	m_Window.reset();
+	m_Current = 0;
+}
+
+template<uint32_t PrecisionBits, uint32_t NumSlices>
+inline const histogram<PrecisionBits>& windowed_histogram<PrecisionBits, NumSlices>::getWindow() const
+{
+	return m_Window;
+}
+
+template<uint32_t PrecisionBits, uint32_t NumSlices>
+inline const histogram<PrecisionBits>& windowed_histogram<PrecisionBits, NumSlices>::getCurrentSlice() const
+{
+	return m_Slices[m_Current];
+}
+}
+
+#endif
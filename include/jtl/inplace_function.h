@@ -0,0 +1,229 @@
+#ifndef JTL_INPLACE_FUNCTION_H
+#define JTL_INPLACE_FUNCTION_H
+
+#include <stdint.h>
+#include <bx/bx.h>
+#include <bx/allocator.h>
+#include "jtl.h"
+
+#include <utility> // std::forward, std::move
+#include <type_traits> // std::aligned_storage, std::decay, std::enable_if
+
+namespace jtl
+{
+template<typename T, uint32_t Capacity = 32, uint32_t Alignment = 16>
+class inplace_function;
+
+// Owning, move-only function wrapper which stores the callable in an inline buffer of
+// Capacity bytes and never allocates. Callables which don't fit are rejected at compile
+// time. Like delegate, invocation goes through a single stub pointer. Moving and
+// destroying go through a second (type-erased) function pointer, which is null for
+// trivially copyable callables (plain memcpy/no-op).
+template<typename RET, typename ...PARAMS, uint32_t Capacity, uint32_t Alignment>
+class inplace_function<RET(PARAMS...), Capacity, Alignment>
+{
+public:
+	inplace_function();
+	inplace_function(std::nullptr_t);
+	inplace_function(inplace_function&& other);
+	~inplace_function();
+
+	template<typename FUNC, typename = typename std::enable_if<!std::is_same<typename std::decay<FUNC>::type, inplace_function>::value>::type>
+	inplace_function(FUNC&& func);
+
+	inplace_function& operator = (inplace_function&& other);
+	inplace_function& operator = (std::nullptr_t);
+
+	template<typename FUNC, typename = typename std::enable_if<!std::is_same<typename std::decay<FUNC>::type, inplace_function>::value>::type>
+	inplace_function& operator = (FUNC&& func);
+
+	RET operator()(PARAMS... params) const;
+
+	bool isNull() const;
+	explicit operator bool() const;
+
+	void reset();
+	void swap(inplace_function& other);
+
+private:
+	typedef RET (*stub_type)(void* this_ptr, PARAMS&&...);
+
+	// Moves the callable from src to dst and destroys src, or only destroys src if dst
+	// is null.
+	typedef void (*manager_type)(void* dst, void* src);
+
+	typedef typename std::aligned_storage<Capacity, Alignment>::type StorageT;
+
+	mutable StorageT m_Storage;
+	stub_type m_Stub;
+	manager_type m_Manager;
+
+	template<typename FUNC>
+	void construct(FUNC&& func);
+
+	void moveFrom(inplace_function& other);
+
+	template<typename FUNC>
+	static RET invoke_stub(void* this_ptr, PARAMS&&... params);
+
+	template<typename FUNC>
+	static void manager(void* dst, void* src);
+
+	inplace_function(const inplace_function&) = delete;
+	inplace_function& operator = (const inplace_function&) = delete;
+};
+
+template<typename RET, typename ...PARAMS, uint32_t Capacity, uint32_t Alignment>
+inline inplace_function<RET(PARAMS...), Capacity, Alignment>::inplace_function()
+	: m_Stub(nullptr)
+	, m_Manager(nullptr)
+{
+}
+
+template<typename RET, typename ...PARAMS, uint32_t Capacity, uint32_t Alignment>
+inline inplace_function<RET(PARAMS...), Capacity, Alignment>::inplace_function(std::nullptr_t)
+	: m_Stub(nullptr)
+	, m_Manager(nullptr)
+{
+}
+
+template<typename RET, typename ...PARAMS, uint32_t Capacity, uint32_t Alignment>
+inline inplace_function<RET(PARAMS...), Capacity, Alignment>::inplace_function(inplace_function&& other)
+	: m_Stub(nullptr)
+	, m_Manager(nullptr)
+{
+	moveFrom(other);
+}
+
+template<typename RET, typename ...PARAMS, uint32_t Capacity, uint32_t Alignment>
+template<typename FUNC, typename>
+inline inplace_function<RET(PARAMS...), Capacity, Alignment>::inplace_function(FUNC&& func)
+	: m_Stub(nullptr)
+	, m_Manager(nullptr)
+{
+	construct(std::forward<FUNC>(func));
+}
+
+template<typename RET, typename ...PARAMS, uint32_t Capacity, uint32_t Alignment>
+inline inplace_function<RET(PARAMS...), Capacity, Alignment>::~inplace_function()
+{
+	reset();
+}
+
+template<typename RET, typename ...PARAMS, uint32_t Capacity, uint32_t Alignment>
+inline inplace_function<RET(PARAMS...), Capacity, Alignment>& inplace_function<RET(PARAMS...), Capacity, Alignment>::operator = (inplace_function&& other)
+{
+	if (&other != this) {
+		reset();
+		moveFrom(other);
+	}
+
+	return *this;
+}
+
+template<typename RET, typename ...PARAMS, uint32_t Capacity, uint32_t Alignment>
+inline inplace_function<RET(PARAMS...), Capacity, Alignment>& inplace_function<RET(PARAMS...), Capacity, Alignment>::operator = (std::nullptr_t)
+{
+	reset();
+	return *this;
+}
+
+template<typename RET, typename ...PARAMS, uint32_t Capacity, uint32_t Alignment>
+template<typename FUNC, typename>
+inline inplace_function<RET(PARAMS...), Capacity, Alignment>& inplace_function<RET(PARAMS...), Capacity, Alignment>::operator = (FUNC&& func)
+{
+	reset();
+	construct(std::forward<FUNC>(func));
+	return *this;
+}
+
+template<typename RET, typename ...PARAMS, uint32_t Capacity, uint32_t Alignment>
+inline RET inplace_function<RET(PARAMS...), Capacity, Alignment>::operator()(PARAMS... params) const
+{
+	JTL_CHECK(m_Stub, "Calling a null inplace_function");
+	return (*m_Stub)(&m_Storage, std::forward<PARAMS>(params)...);
+}
+
+template<typename RET, typename ...PARAMS, uint32_t Capacity, uint32_t Alignment>
+inline bool inplace_function<RET(PARAMS...), Capacity, Alignment>::isNull() const
+{
+	return m_Stub == nullptr;
+}
+
+template<typename RET, typename ...PARAMS, uint32_t Capacity, uint32_t Alignment>
+inline inplace_function<RET(PARAMS...), Capacity, Alignment>::operator bool() const
+{
+	return m_Stub != nullptr;
+}
+
+template<typename RET, typename ...PARAMS, uint32_t Capacity, uint32_t Alignment>
+inline void inplace_function<RET(PARAMS...), Capacity, Alignment>::reset()
+{
+	if (m_Manager) {
+		m_Manager(nullptr, &m_Storage);
+	}
+
+	m_Stub = nullptr;
+	m_Manager = nullptr;
+}
+
+template<typename RET, typename ...PARAMS, uint32_t Capacity, uint32_t Alignment>
+inline void inplace_function<RET(PARAMS...), Capacity, Alignment>::swap(inplace_function& other)
+{
+	if (&other != this) {
+		inplace_function tmp(std::move(other));
+		other = std::move(*this);
+		*this = std::move(tmp);
+	}
+}
+
+template<typename RET, typename ...PARAMS, uint32_t Capacity, uint32_t Alignment>
+template<typename FUNC>
+inline void inplace_function<RET(PARAMS...), Capacity, Alignment>::construct(FUNC&& func)
+{
+	typedef typename std::decay<FUNC>::type FuncT;
+	static_assert(sizeof(FuncT) <= Capacity, "Callable doesn't fit in the inplace_function; increase Capacity");
+	static_assert(Alignment % std::alignment_of<FuncT>::value == 0, "Callable alignment not supported by the inplace_function; increase Alignment");
+
+	BX_PLACEMENT_NEW(&m_Storage, FuncT)(std::forward<FUNC>(func));
+	m_Stub = invoke_stub<FuncT>;
+	m_Manager = std::is_trivially_copyable<FuncT>::value ? nullptr : manager<FuncT>;
+}
+
+template<typename RET, typename ...PARAMS, uint32_t Capacity, uint32_t Alignment>
+inline void inplace_function<RET(PARAMS...), Capacity, Alignment>::moveFrom(inplace_function& other)
+{
+	if (other.m_Manager) {
+		other.m_Manager(&m_Storage, &other.m_Storage);
+	} else if (other.m_Stub) {
+		bx::memCopy(&m_Storage, &other.m_Storage, sizeof(StorageT));
+	}
+
+	m_Stub = other.m_Stub;
+	m_Manager = other.m_Manager;
+	other.m_Stub = nullptr;
+	other.m_Manager = nullptr;
+}
+
+template<typename RET, typename ...PARAMS, uint32_t Capacity, uint32_t Alignment>
+template<typename FUNC>
+inline RET inplace_function<RET(PARAMS...), Capacity, Alignment>::invoke_stub(void* this_ptr, PARAMS&&... params)
+{
+	FUNC* func = static_cast<FUNC*>(this_ptr);
+	return (*func)(std::forward<PARAMS>(params)...);
+}
+
+template<typename RET, typename ...PARAMS, uint32_t Capacity, uint32_t Alignment>
+template<typename FUNC>
+inline void inplace_function<RET(PARAMS...), Capacity, Alignment>::manager(void* dst, void* src)
+{
+	FUNC* srcFunc = static_cast<FUNC*>(src);
+	if (dst) {
+		BX_PLACEMENT_NEW(dst, FUNC)(std::move(*srcFunc));
+	}
+
+	srcFunc->~FUNC();
+}
+}
+
+#endif
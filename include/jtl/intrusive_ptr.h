@@ -0,0 +1,305 @@
+#ifndef JTL_INTRUSIVE_PTR_H
+#define JTL_INTRUSIVE_PTR_H
+
+#include <stdint.h>
+#include <bx/bx.h>
+#include "jtl.h"
+#include "ref_count.h"
+
+#include <utility> // std::forward
+#include <type_traits> // std::enable_if, std::is_convertible
+
+namespace jtl
+{
+// CRTP base which embeds the reference count in Derived. Policy is one of the reference
+// counting policies from ref_count.h. The count starts at 0 and the object is destroyed by
+// calling Derived::destroy() when it drops back to 0. The default destroy() uses delete;
+// objects allocated differently (e.g. with BX_NEW) should provide their own.
+//
+// Copying an object doesn't copy its reference count.
+template<typename Derived, typename Policy = atomic_ref_count>
+class intrusive_ref_count
+{
+public:
+	void addRef() const;
+	void release() const;
+	int32_t getRefCount() const;
+
+protected:
+	intrusive_ref_count();
+	intrusive_ref_count(const intrusive_ref_count& other);
+	~intrusive_ref_count();
+
+	intrusive_ref_count& operator = (const intrusive_ref_count& other);
+
+	void destroy() const;
+
+private:
+	mutable Policy m_RefCount;
+
+	static void releaseStub(void* userData);
+};
+
+// Smart pointer to an object with an embedded reference count, i.e. any type providing
+// addRef() and release() (usually by deriving from intrusive_ref_count). It's a single
+// pointer and any raw pointer to such an object can be turned back into an
+// intrusive_ptr, no matter how the object was created.
+template<typename T>
+class intrusive_ptr
+{
+public:
+	intrusive_ptr();
+	intrusive_ptr(std::nullptr_t);
+	intrusive_ptr(T* ptr, bool addRef = true);
+	intrusive_ptr(const intrusive_ptr& other);
+	intrusive_ptr(intrusive_ptr&& other);
+	~intrusive_ptr();
+
+	template<typename U, typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+	intrusive_ptr(const intrusive_ptr<U>& other);
+
+	template<typename U, typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+	intrusive_ptr(intrusive_ptr<U>&& other);
+
+	intrusive_ptr<T>& operator = (const intrusive_ptr<T>& other);
+	intrusive_ptr<T>& operator = (intrusive_ptr<T>&& other);
+	intrusive_ptr<T>& operator = (T* ptr);
+
+	T* get() const;
+	T* operator -> () const;
+	T& operator * () const;
+
+	operator bool() const;
+
+	void reset();
+	void reset(T* ptr, bool addRef = true);
+
+	// Returns the pointer without releasing the reference the intrusive_ptr held, and
+	// leaves the intrusive_ptr empty. Use intrusive_ptr(ptr, false) to take it back.
+	T* detach();
+
+	void swap(intrusive_ptr<T>& other);
+
+private:
+	template<typename U>
+	friend class intrusive_ptr;
+
+	T* m_Ptr;
+};
+
+template<typename T, typename... Args>
+inline intrusive_ptr<T> make_intrusive(Args&&... args)
+{
+	return intrusive_ptr<T>(new T(std::forward<Args>(args)...));
+}
+
+template<typename Derived, typename Policy>
+inline intrusive_ref_count<Derived, Policy>::intrusive_ref_count()
+	: m_RefCount(0)
+{
+	setReleaseCallback(m_RefCount, releaseStub, this);
+}
+
+template<typename Derived, typename Policy>
+inline intrusive_ref_count<Derived, Policy>::intrusive_ref_count(const intrusive_ref_count& /*other*/)
+	: m_RefCount(0)
+{
+	setReleaseCallback(m_RefCount, releaseStub, this);
+}
+
+template<typename Derived, typename Policy>
+inline intrusive_ref_count<Derived, Policy>::~intrusive_ref_count()
+{
+}
+
+template<typename Derived, typename Policy>
+inline intrusive_ref_count<Derived, Policy>& intrusive_ref_count<Derived, Policy>::operator = (const intrusive_ref_count& /*other*/)
+{
+	return *this;
+}
+
+template<typename Derived, typename Policy>
+inline void intrusive_ref_count<Derived, Policy>::addRef() const
+{
+	m_RefCount.increment();
+}
+
+template<typename Derived, typename Policy>
+inline void intrusive_ref_count<Derived, Policy>::release() const
+{
+	if (m_RefCount.decrement()) {
+		static_cast<const Derived*>(this)->destroy();
+	}
+}
+
+template<typename Derived, typename Policy>
+inline int32_t intrusive_ref_count<Derived, Policy>::getRefCount() const
+{
+	return m_RefCount.get();
+}
+
+template<typename Derived, typename Policy>
+inline void intrusive_ref_count<Derived, Policy>::destroy() const
+{
+	delete static_cast<const Derived*>(this);
+}
+
+template<typename Derived, typename Policy>
+inline void intrusive_ref_count<Derived, Policy>::releaseStub(void* userData)
+{
+	static_cast<const Derived*>(static_cast<intrusive_ref_count*>(userData))->destroy();
+}
+
+template<typename T>
+inline intrusive_ptr<T>::intrusive_ptr()
+	: m_Ptr(nullptr)
+{
+}
+
+template<typename T>
+inline intrusive_ptr<T>::intrusive_ptr(std::nullptr_t)
+	: m_Ptr(nullptr)
+{
+}
+
+template<typename T>
+inline intrusive_ptr<T>::intrusive_ptr(T* ptr, bool addRef)
+	: m_Ptr(ptr)
+{
+	if (m_Ptr && addRef) {
+		m_Ptr->addRef();
+	}
+}
+
+template<typename T>
+inline intrusive_ptr<T>::intrusive_ptr(const intrusive_ptr<T>& other)
+	: m_Ptr(other.m_Ptr)
+{
+	if (m_Ptr) {
+		m_Ptr->addRef();
+	}
+}
+
+template<typename T>
+inline intrusive_ptr<T>::intrusive_ptr(intrusive_ptr<T>&& other)
+	: m_Ptr(other.m_Ptr)
+{
+	other.m_Ptr = nullptr;
+}
+
+template<typename T>
+template<typename U, typename>
+inline intrusive_ptr<T>::intrusive_ptr(const intrusive_ptr<U>& other)
+	: m_Ptr(other.m_Ptr)
+{
+	if (m_Ptr) {
+		m_Ptr->addRef();
+	}
+}
+
+template<typename T>
+template<typename U, typename>
+inline intrusive_ptr<T>::intrusive_ptr(intrusive_ptr<U>&& other)
+	: m_Ptr(other.m_Ptr)
+{
+	other.m_Ptr = nullptr;
+}
+
+template<typename T>
+inline intrusive_ptr<T>::~intrusive_ptr()
+{
+	if (m_Ptr) {
+		m_Ptr->release();
+	}
+}
+
+template<typename T>
+inline intrusive_ptr<T>& intrusive_ptr<T>::operator = (const intrusive_ptr<T>& other)
+{
+	intrusive_ptr<T>(other).swap(*this);
+	return *this;
+}
+
+template<typename T>
+inline intrusive_ptr<T>& intrusive_ptr<T>::operator = (intrusive_ptr<T>&& other)
+{
+	if (&other != this) {
+		intrusive_ptr<T>(static_cast<intrusive_ptr<T>&&>(other)).swap(*this);
+	}
+
+	return *this;
+}
+
+template<typename T>
+inline intrusive_ptr<T>& intrusive_ptr<T>::operator = (T* ptr)
+{
+	intrusive_ptr<T>(ptr).swap(*this);
+	return *this;
+}
+
+template<typename T>
+inline T* intrusive_ptr<T>::get() const
+{
+	return m_Ptr;
+}
+
+template<typename T>
+inline T* intrusive_ptr<T>::operator -> () const
+{
+	return m_Ptr;
+}
+
+template<typename T>
+inline T& intrusive_ptr<T>::operator * () const
+{
+	return *m_Ptr;
+}
+
+template<typename T>
+inline intrusive_ptr<T>::operator bool() const
+{
+	return m_Ptr != nullptr;
+}
+
+template<typename T>
+inline void intrusive_ptr<T>::reset()
+{
+	intrusive_ptr<T>().swap(*this);
+}
+
+template<typename T>
+inline void intrusive_ptr<T>::reset(T* ptr, bool addRef)
+{
+	intrusive_ptr<T>(ptr, addRef).swap(*this);
+}
+
+template<typename T>
+inline T* intrusive_ptr<T>::detach()
+{
+	T* ptr = m_Ptr;
+	m_Ptr = nullptr;
+	return ptr;
+}
+
+template<typename T>
+inline void intrusive_ptr<T>::swap(intrusive_ptr<T>& other)
+{
+	T* const ptr = other.m_Ptr;
+	other.m_Ptr = m_Ptr;
+	m_Ptr = ptr;
+}
+
+template<typename T, typename U>
+inline bool operator == (const intrusive_ptr<T>& a, const intrusive_ptr<U>& b)
+{
+	return a.get() == b.get();
+}
+
+template<typename T, typename U>
+inline bool operator != (const intrusive_ptr<T>& a, const intrusive_ptr<U>& b)
+{
+	return a.get() != b.get();
+}
+}
+
+#endif
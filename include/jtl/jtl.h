@@ -42,7 +42,41 @@ namespace jtl
 {
 typedef bx::AllocatorI* (*GetAllocatorFunc)();
 
+// Allocator used by everything which isn't given one explicitly. It's a
+// bx::DefaultAllocator unless replaced with setDefaultAllocator(), which must happen
+// before anything is allocated from it (containers using getDefaultAllocator as their
+// GetAllocatorFunc free their memory through whichever allocator it returns at that
+// time). Returns the previous default allocator; nullptr restores the original one.
 bx::AllocatorI* getDefaultAllocator();
+bx::AllocatorI* setDefaultAllocator(bx::AllocatorI* allocator);
+
+// Per thread allocator, installed with allocator_scope and falling back to the default
+// allocator outside of any scope. Use it as the allocator of temporaries which don't
+// outlive the scope, e.g. vector<T, getScopedAllocator> or string(getScopedAllocator()).
+bx::AllocatorI* getScopedAllocator();
+bx::AllocatorI* setScopedAllocator(bx::AllocatorI* allocator);
+
+// Makes getScopedAllocator() return allocator on the calling thread until the end of
+// the scope. Scopes can be nested.
+class allocator_scope
+{
+public:
+	explicit allocator_scope(bx::AllocatorI* allocator)
+		: m_Previous(setScopedAllocator(allocator))
+	{
+	}
+
+	~allocator_scope()
+	{
+		setScopedAllocator(m_Previous);
+	}
+
+private:
+	bx::AllocatorI* m_Previous;
+
+	allocator_scope(const allocator_scope&) = delete;
+	allocator_scope& operator = (const allocator_scope&) = delete;
+};
 
 uint32_t fnv1a(const void* buffer, uint32_t len);
 
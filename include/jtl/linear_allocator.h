@@ -0,0 +1,119 @@
+#ifndef JTL_LINEAR_ALLOCATOR_H
+#define JTL_LINEAR_ALLOCATOR_H
+
+#include <stdint.h>
+#include <bx/allocator.h>
+#include "jtl.h"
+
+namespace jtl
+{
+struct LinearBlock;
+
+// Bump (arena) allocator. Allocating moves a pointer forward in the current block, and
+// freeing does nothing except for the most recent allocation, which is rolled back (so
+// a growing vector reallocates in place). All the memory is reclaimed at once with
+// reset() or by rewinding to a marker, e.g. with a linear_allocator_scope at the end of
+// a request. Blocks are allocated from the backing allocator as needed and kept for
+// reuse after a reset until release() or destruction.
+//
+// Not thread safe; use one allocator per thread. Every allocation has an 8 byte header
+// holding its size so that realloc() can copy it.
+class linear_allocator : public bx::AllocatorI
+{
+public:
+	struct marker
+	{
+		LinearBlock* m_Block;
+		size_t m_Offset;
+	};
+
+	linear_allocator(size_t blockSize = 64 * 1024, bx::AllocatorI* backingAllocator = nullptr);
+	virtual ~linear_allocator();
+
+	virtual void* realloc(void* _ptr, size_t _size, size_t _align, const char* _file, uint32_t _line) override;
+
+	// Frees everything allocated since the marker was taken.
+	marker getMarker() const;
+	void rewind(const marker& m);
+
+	// Frees everything, keeping the blocks for reuse.
+	void reset();
+
+	// Frees everything and returns the blocks to the backing allocator.
+	void release();
+
+	// Total size of the blocks owned by the allocator.
+	size_t getCapacity() const;
+
+private:
+	bx::AllocatorI* m_BackingAllocator;
+	LinearBlock* m_FirstBlock;
+	LinearBlock* m_LastBlock;
+	LinearBlock* m_CurrentBlock;
+	void* m_LastAlloc;
+	size_t m_LastAllocOffset; // Offset in the current block before the last allocation
+	size_t m_Offset;
+	size_t m_BlockSize;
+
+	void* alloc(size_t size, size_t align);
+	void free(void* ptr);
+	bool tryResize(void* ptr, size_t size);
+
+	linear_allocator(const linear_allocator&) = delete;
+	linear_allocator& operator = (const linear_allocator&) = delete;
+};
+
+// Rewinds the allocator to its state at construction when going out of scope.
+class linear_allocator_scope
+{
+public:
+	explicit linear_allocator_scope(linear_allocator& allocator)
+		: m_Allocator(allocator)
+		, m_Marker(allocator.getMarker())
+	{
+	}
+
+	~linear_allocator_scope()
+	{
+		m_Allocator.rewind(m_Marker);
+	}
+
+private:
+	linear_allocator& m_Allocator;
+	linear_allocator::marker m_Marker;
+
+	linear_allocator_scope(const linear_allocator_scope&) = delete;
+	linear_allocator_scope& operator = (const linear_allocator_scope&) = delete;
+};
+
+// Pair of linear allocators used alternately, one per frame. nextFrame() switches to the
+// other allocator and resets it, so memory allocated during a frame stays valid during
+// the next one (e.g. data produced in a frame and consumed in the following one) and is
+// reclaimed at the beginning of the frame after that.
+class frame_allocator : public bx::AllocatorI
+{
+public:
+	frame_allocator(size_t blockSize = 64 * 1024, bx::AllocatorI* backingAllocator = nullptr);
+	virtual ~frame_allocator();
+
+	virtual void* realloc(void* _ptr, size_t _size, size_t _align, const char* _file, uint32_t _line) override;
+
+	void nextFrame();
+
+	linear_allocator& getCurrent();
+
+private:
+	linear_allocator m_Frames[2];
+	uint32_t m_Current;
+
+	frame_allocator(const frame_allocator&) = delete;
+	frame_allocator& operator = (const frame_allocator&) = delete;
+};
+
+inline linear_allocator& frame_allocator::getCurrent()
+{
+	return m_Frames[m_Current];
+}
+}
+
+#endif
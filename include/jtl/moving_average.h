@@ -4,9 +4,18 @@
 #include <stdint.h>
 #include <bx/bx.h>
 #include <bx/math.h>
+#include <bx/allocator.h>
+#include <math.h> // exp2(), expm1()
+#include "jtl.h"
 
 namespace jtl
 {
+// Average, standard deviation and bounds of the last N inserted values. insert() is
+// amortized O(1) and all the queries are O(1):
+// - The mean and the sum of squared differences are updated incrementally (Welford),
+//   and recomputed from the window every time it wraps around so that rounding errors
+//   don't accumulate.
+// - The min/max are the fronts of two monotonic queues of window slots.
 template<typename T, uint32_t N>
 class moving_average
 {
@@ -15,21 +24,207 @@ public:
 	~moving_average();
 
 	T insert(T v);
+
+	// Same as calling insert() for every value, with the running sums updated once per
+	// contiguous run of window slots.
+	T insert_batch(const T* v, uint32_t n);
+
 	T getAverage() const;
-	void getBounds(T& minT, T& maxT);
-	T getStdDev();
+	void getBounds(T& minT, T& maxT) const;
+	T getStdDev() const;
 
 private:
+	// Ring of window slots whose values are sorted (increasing for the min queue,
+	// decreasing for the max queue).
+	struct MonotonicQueue
+	{
+		uint32_t m_Slots[N];
+		uint32_t m_Head;
+		uint32_t m_Size;
+
+		uint32_t front() const
+		{
+			return m_Slots[m_Head];
+		}
+
+		uint32_t back() const
+		{
+			return m_Slots[(m_Head + m_Size - 1) % N];
+		}
+
+		void pushBack(uint32_t slot)
+		{
+			m_Slots[(m_Head + m_Size) % N] = slot;
+			m_Size++;
+		}
+
+		void popFront()
+		{
+			m_Head = (m_Head + 1) % N;
+			m_Size--;
+		}
+
+		void popBack()
+		{
+			m_Size--;
+		}
+	};
+
 	T m_Data[N];
+	MonotonicQueue m_MinQueue;
+	MonotonicQueue m_MaxQueue;
 	T m_Total;
+	double m_Mean;
+	double m_M2; // Sum of squared differences from the mean
 	uint32_t m_Count;
 	uint32_t m_InsertPos;
+
+	void updateBounds(uint32_t pos, T v);
+	void resync();
 };
 
+// K moving averages over windows of N values advancing together, e.g. one per shard or
+// per endpoint, updated once per tick with one value per series. The window is stored
+// as N rows of K values (structure of arrays), so insert() is a few linear passes over
+// contiguous arrays which the compiler vectorizes, instead of K calls touching K
+// separate objects.
+//
+// The passes are plain loops left to the auto-vectorizer (GCC vectorizes them at -O3)
+// rather than SSE2/AVX2 intrinsics like in string.cpp and utf8.cpp: they're templated on
+// T, so intrinsics would need a specialization per element type.
+//
+// Averages and standard deviations are maintained incrementally like in
+// moving_average. Bounds aren't tracked (monotonic queues don't vectorize);
+// getBounds() scans the series' column in O(N).
 template<typename T, uint32_t N>
-moving_average<T, N>::moving_average() : m_Total(0), m_Count(0), m_InsertPos(0)
+class multi_moving_average
+{
+public:
+	multi_moving_average(uint32_t numSeries, bx::AllocatorI* allocator = nullptr);
+	~multi_moving_average();
+
+	// Inserts values[i] in series i, for all the series.
+	void insert(const T* values);
+
+	uint32_t getNumSeries() const;
+	uint32_t getCount() const;
+
+	T getAverage(uint32_t series) const;
+	T getStdDev(uint32_t series) const;
+	void getBounds(uint32_t series, T& minT, T& maxT) const;
+
+	// Averages of all the series.
+	void getAverages(T* averages) const;
+
+private:
+	bx::AllocatorI* m_Allocator;
+	T* m_Data; // N rows of m_NumSeries values
+	T* m_Total;
+	double* m_Mean;
+	double* m_M2;
+	uint32_t m_NumSeries;
+	uint32_t m_Count;
+	uint32_t m_InsertPos;
+
+	void resync();
+
+	multi_moving_average(const multi_moving_average&) = delete;
+	multi_moving_average& operator = (const multi_moving_average&) = delete;
+};
+
+// Exponential moving average with a half-life: a sample's weight halves every halfLife
+// units of time. Only the current average is stored. insert(v, time) handles irregular
+// sample intervals; insert(v) treats every sample as one unit of time, i.e. the
+// half-life is expressed in samples.
+template<typename T>
+class exponential_moving_average
+{
+public:
+	exponential_moving_average(double halfLife);
+	~exponential_moving_average();
+
+	T insert(T v);
+	T insert(T v, double time);
+	T getAverage() const;
+	void reset();
+
+private:
+	T m_Value;
+	double m_HalfLife;
+	double m_LastTime;
+	bool m_HasValue;
+};
+
+// Exponentially decaying rate of events per unit of time (e.g. requests per second if
+// times are in seconds). Only the decayed event count is stored. The rate is corrected
+// for the time elapsed since the first event, so it doesn't ramp up slowly on startup.
+class exponential_rate
+{
+public:
+	exponential_rate(double halfLife);
+	~exponential_rate();
+
+	void add(double time, double count = 1.0);
+	double getRate(double time) const;
+	void reset();
+
+private:
+	double m_HalfLife;
+	double m_Sum; // Decayed count at m_LastTime
+	double m_StartTime;
+	double m_LastTime;
+	bool m_Started;
+};
+
+// Average and rates over the last windowDuration units of time. The window is split in
+// NumBuckets buckets indexed by timestamp, so memory doesn't depend on the number of
+// samples. Buckets older than the window are ignored by queries and recycled by
+// insert(). insert() is O(1) and the queries are O(NumBuckets).
+//
+// Timestamps must be non-decreasing (they're compared at bucket granularity).
+template<typename T, uint32_t NumBuckets = 16>
+class time_window_average
+{
+public:
+	time_window_average(double windowDuration);
+	~time_window_average();
+
+	void insert(T v, double time);
+	void reset();
+
+	T getAverage(double time) const;
+	uint32_t getCount(double time) const;
+
+	// Samples per unit of time, and sum of the sample values per unit of time.
+	double getRate(double time) const;
+	double getSumRate(double time) const;
+
+private:
+	struct Bucket
+	{
+		T m_Sum;
+		uint32_t m_Count;
+		int64_t m_Index;
+	};
+
+	Bucket m_Buckets[NumBuckets];
+	double m_BucketDuration;
+	double m_StartTime;
+	bool m_Started;
+
+	int64_t getBucketIndex(double time) const;
+	void sum(double time, T& sum, uint32_t& count) const;
+	double getCoveredDuration(double time) const;
+};
+
+template<typename T, uint32_t N>
+moving_average<T, N>::moving_average() : m_Total(0), m_Mean(0.0), m_M2(0.0), m_Count(0), m_InsertPos(0)
 {
 	bx::memSet(m_Data, 0, sizeof(T) * N);
+	m_MinQueue.m_Head = 0;
+	m_MinQueue.m_Size = 0;
+	m_MaxQueue.m_Head = 0;
+	m_MaxQueue.m_Size = 0;
 }
 
 template<typename T, uint32_t N>
@@ -40,14 +235,123 @@ moving_average<T, N>::~moving_average()
 template<typename T, uint32_t N>
 T moving_average<T, N>::insert(T v)
 {
-	m_Total -= m_Data[m_InsertPos];
+	const uint32_t pos = m_InsertPos;
+	const double x = (double)v;
+
+	updateBounds(pos, v);
+
+	if (m_Count == N) {
+		const double old = (double)m_Data[pos];
+		const double mean = m_Mean + (x - old) / N;
+		m_M2 += (x - old) * (x - mean + old - m_Mean);
+		m_M2 = m_M2 < 0.0 ? 0.0 : m_M2;
+		m_Mean = mean;
+	} else {
+		m_Count++;
+		const double delta = x - m_Mean;
+		m_Mean += delta / m_Count;
+		m_M2 += delta * (x - m_Mean);
+	}
+
+	m_Total -= m_Data[pos];
 	m_Total += v;
-	m_Data[m_InsertPos] = v;
+	m_Data[pos] = v;
 	m_InsertPos = (m_InsertPos + 1) % N;
 
-	m_Count++;
-	if (m_Count > N) {
-		m_Count = N;
+	if (m_InsertPos == 0) {
+		resync();
+	}
+
+	return getAverage();
+}
+
+template<typename T, uint32_t N>
+T moving_average<T, N>::insert_batch(const T* v, uint32_t n)
+{
+	// Only the last N values can end up in the window.
+	if (n > N) {
+		v += n - N;
+		n = N;
+	}
+
+	while (n) {
+		// Run of slots which are either all empty or all in use, without wrapping.
+		const uint32_t pos = m_InsertPos;
+		const uint32_t count = bx::min(n, N - pos);
+		const T* values = v;
+		const T* old = &m_Data[pos];
+
+		// Statistics of the values entering and leaving the window.
+		T total = T(0);
+		T oldTotal = T(0);
+		double sum = 0.0;
+		double oldSum = 0.0;
+		for (uint32_t i = 0; i < count; ++i) {
+			total += values[i];
+			sum += (double)values[i];
+		}
+
+		const bool replace = m_Count == N;
+		if (replace) {
+			for (uint32_t i = 0; i < count; ++i) {
+				oldTotal += old[i];
+				oldSum += (double)old[i];
+			}
+		}
+
+		const double mean = sum / count;
+		const double oldMean = oldSum / count;
+		double m2 = 0.0;
+		double oldM2 = 0.0;
+		for (uint32_t i = 0; i < count; ++i) {
+			const double d = (double)values[i] - mean;
+			m2 += d * d;
+		}
+
+		if (replace) {
+			for (uint32_t i = 0; i < count; ++i) {
+				const double d = (double)old[i] - oldMean;
+				oldM2 += d * d;
+			}
+		}
+
+		for (uint32_t i = 0; i < count; ++i) {
+			updateBounds(pos + i, values[i]);
+			m_Data[pos + i] = values[i];
+		}
+
+		if (replace) {
+			// Remove the old values (the remaining part is empty if the whole window is
+			// replaced)...
+			const uint32_t remaining = N - count;
+			if (remaining) {
+				const double remainingMean = (m_Mean * N - oldSum) / remaining;
+				const double delta = oldMean - remainingMean;
+				m_M2 -= oldM2 + delta * delta * ((double)remaining * count / N);
+				m_Mean = remainingMean;
+			} else {
+				m_M2 = 0.0;
+				m_Mean = 0.0;
+			}
+			m_Count = remaining;
+		}
+
+		// ...and add the new ones (Chan et al.'s parallel variance).
+		const uint32_t newCount = m_Count + count;
+		const double delta = mean - m_Mean;
+		m_M2 += m2 + delta * delta * ((double)m_Count * count / newCount);
+		m_M2 = m_M2 < 0.0 ? 0.0 : m_M2;
+		m_Mean += delta * count / newCount;
+		m_Count = newCount;
+
+		m_Total += total - oldTotal;
+		m_InsertPos = (pos + count) % N;
+		if (m_InsertPos == 0) {
+			resync();
+		}
+
+		v += count;
+		n -= count;
 	}
 
 	return getAverage();
@@ -56,11 +360,11 @@ T moving_average<T, N>::insert(T v)
 template<typename T, uint32_t N>
 T moving_average<T, N>::getAverage() const
 {
-	return m_Total / m_Count;
+	return m_Count ? m_Total / m_Count : T(0);
 }
 
 template<typename T, uint32_t N>
-void moving_average<T, N>::getBounds(T& minT, T& maxT)
+void moving_average<T, N>::getBounds(T& minT, T& maxT) const
 {
 	if (m_Count == 0) {
 		minT = T(0);
@@ -68,34 +372,449 @@ void moving_average<T, N>::getBounds(T& minT, T& maxT)
 		return;
 	}
 
-	minT = m_Data[0];
-	maxT = m_Data[0];
-	const uint32_t n = m_Count;
-	for (uint32_t i = 1; i < n; ++i) {
-		T v = m_Data[i];
-		minT = v < minT ? v : minT;
-		maxT = v > maxT ? v : maxT;
-	}
+	minT = m_Data[m_MinQueue.front()];
+	maxT = m_Data[m_MaxQueue.front()];
 }
 
 template<typename T, uint32_t N>
-T moving_average<T, N>::getStdDev()
+T moving_average<T, N>::getStdDev() const
 {
 	if (m_Count == 0) {
 		return T(0);
 	}
 
-	const T avg = getAverage();
-	T stdDev = T(0.0);
+	return T(bx::sqrt((float)(m_M2 / m_Count)));
+}
+
+// Pushes the value inserted in pos into the monotonic queues. Must be called before the
+// value is written to the window.
+template<typename T, uint32_t N>
+inline void moving_average<T, N>::updateBounds(uint32_t pos, T v)
+{
+	if (m_Count == N) {
+		// The value in pos leaves the window. If it's still in a queue, it's the oldest
+		// value of the queue.
+		if (m_MinQueue.m_Size && m_MinQueue.front() == pos) {
+			m_MinQueue.popFront();
+		}
+		if (m_MaxQueue.m_Size && m_MaxQueue.front() == pos) {
+			m_MaxQueue.popFront();
+		}
+	}
+
+	while (m_MinQueue.m_Size && !(m_Data[m_MinQueue.back()] < v)) {
+		m_MinQueue.popBack();
+	}
+	m_MinQueue.pushBack(pos);
+
+	while (m_MaxQueue.m_Size && !(m_Data[m_MaxQueue.back()] > v)) {
+		m_MaxQueue.popBack();
+	}
+	m_MaxQueue.pushBack(pos);
+}
+
+// Recomputes the running sums from the window. Called once every N inserts, which keeps
+// insert() amortized O(1).
+template<typename T, uint32_t N>
+void moving_average<T, N>::resync()
+{
 	const uint32_t n = m_Count;
+
+	T total = T(0);
+	double sum = 0.0;
 	for (uint32_t i = 0; i < n; ++i) {
-		T v = m_Data[i];
-		T d = v - avg;
+		total += m_Data[i];
+		sum += (double)m_Data[i];
+	}
+
+	const double mean = sum / n;
+	double m2 = 0.0;
+	for (uint32_t i = 0; i < n; ++i) {
+		const double d = (double)m_Data[i] - mean;
+		m2 += d * d;
+	}
+
+	m_Total = total;
+	m_Mean = mean;
+	m_M2 = m2;
+}
+
+template<typename T, uint32_t N>
+multi_moving_average<T, N>::multi_moving_average(uint32_t numSeries, bx::AllocatorI* allocator)
+	: m_Allocator(allocator ? allocator : getDefaultAllocator())
+	, m_NumSeries(numSeries)
+	, m_Count(0)
+	, m_InsertPos(0)
+{
+	m_Data = (T*)BX_ALIGNED_ALLOC(m_Allocator, sizeof(T) * N * numSeries, BX_CACHE_LINE_SIZE);
+	m_Total = (T*)BX_ALIGNED_ALLOC(m_Allocator, sizeof(T) * numSeries, BX_CACHE_LINE_SIZE);
+	m_Mean = (double*)BX_ALIGNED_ALLOC(m_Allocator, sizeof(double) * numSeries, BX_CACHE_LINE_SIZE);
+	m_M2 = (double*)BX_ALIGNED_ALLOC(m_Allocator, sizeof(double) * numSeries, BX_CACHE_LINE_SIZE);
+	JTL_CHECK(m_Data && m_Total && m_Mean && m_M2, "Allocation failed");
+
+	bx::memSet(m_Data, 0, sizeof(T) * N * numSeries);
+	for (uint32_t i = 0; i < numSeries; ++i) {
+		m_Total[i] = T(0);
+		m_Mean[i] = 0.0;
+		m_M2[i] = 0.0;
+	}
+}
+
+template<typename T, uint32_t N>
+multi_moving_average<T, N>::~multi_moving_average()
+{
+	BX_ALIGNED_FREE(m_Allocator, m_M2, BX_CACHE_LINE_SIZE);
+	BX_ALIGNED_FREE(m_Allocator, m_Mean, BX_CACHE_LINE_SIZE);
+	BX_ALIGNED_FREE(m_Allocator, m_Total, BX_CACHE_LINE_SIZE);
+	BX_ALIGNED_FREE(m_Allocator, m_Data, BX_CACHE_LINE_SIZE);
+}
+
+template<typename T, uint32_t N>
+void multi_moving_average<T, N>::insert(const T* values)
+{
+	const uint32_t numSeries = m_NumSeries;
+	T* row = &m_Data[(size_t)m_InsertPos * numSeries];
+	T* total = m_Total;
+	double* mean = m_Mean;
+	double* m2 = m_M2;
+
+	if (m_Count == N) {
+		const double invN = 1.0 / N;
+		for (uint32_t i = 0; i < numSeries; ++i) {
+			const double x = (double)values[i];
+			const double old = (double)row[i];
+			const double newMean = mean[i] + (x - old) * invN;
+			const double newM2 = m2[i] + (x - old) * (x - newMean + old - mean[i]);
+			m2[i] = newM2 < 0.0 ? 0.0 : newM2;
+			mean[i] = newMean;
+		}
+	} else {
+		m_Count++;
+		const double invCount = 1.0 / m_Count;
+		for (uint32_t i = 0; i < numSeries; ++i) {
+			const double x = (double)values[i];
+			const double delta = x - mean[i];
+			mean[i] += delta * invCount;
+			m2[i] += delta * (x - mean[i]);
+		}
+	}
+
+	for (uint32_t i = 0; i < numSeries; ++i) {
+		total[i] += values[i] - row[i];
+		row[i] = values[i];
+	}
+
+	m_InsertPos = (m_InsertPos + 1) % N;
+	if (m_InsertPos == 0) {
+		resync();
+	}
+}
+
+template<typename T, uint32_t N>
+inline uint32_t multi_moving_average<T, N>::getNumSeries() const
+{
+	return m_NumSeries;
+}
 
-		stdDev += d * d;
+template<typename T, uint32_t N>
+inline uint32_t multi_moving_average<T, N>::getCount() const
+{
+	return m_Count;
+}
+
+template<typename T, uint32_t N>
+inline T multi_moving_average<T, N>::getAverage(uint32_t series) const
+{
+	return m_Count ? m_Total[series] / m_Count : T(0);
+}
+
+template<typename T, uint32_t N>
+inline T multi_moving_average<T, N>::getStdDev(uint32_t series) const
+{
+	return m_Count ? T(bx::sqrt((float)(m_M2[series] / m_Count))) : T(0);
+}
+
+template<typename T, uint32_t N>
+void multi_moving_average<T, N>::getBounds(uint32_t series, T& minT, T& maxT) const
+{
+	if (m_Count == 0) {
+		minT = T(0);
+		maxT = T(0);
+		return;
+	}
+
+	const T* data = &m_Data[series];
+	minT = data[0];
+	maxT = data[0];
+	for (uint32_t i = 1; i < m_Count; ++i) {
+		const T v = data[(size_t)i * m_NumSeries];
+		minT = v < minT ? v : minT;
+		maxT = v > maxT ? v : maxT;
+	}
+}
+
+template<typename T, uint32_t N>
+void multi_moving_average<T, N>::getAverages(T* averages) const
+{
+	const uint32_t numSeries = m_NumSeries;
+	const uint32_t count = m_Count ? m_Count : 1;
+	for (uint32_t i = 0; i < numSeries; ++i) {
+		averages[i] = m_Total[i] / count;
+	}
+}
+
+// Recomputes the running sums from the window, row by row, once every N inserts.
+template<typename T, uint32_t N>
+void multi_moving_average<T, N>::resync()
+{
+	const uint32_t numSeries = m_NumSeries;
+	T* total = m_Total;
+	double* mean = m_Mean;
+	double* m2 = m_M2;
+
+	for (uint32_t i = 0; i < numSeries; ++i) {
+		total[i] = T(0);
+		mean[i] = 0.0;
+		m2[i] = 0.0;
+	}
+
+	for (uint32_t row = 0; row < m_Count; ++row) {
+		const T* data = &m_Data[(size_t)row * numSeries];
+		for (uint32_t i = 0; i < numSeries; ++i) {
+			total[i] += data[i];
+			mean[i] += (double)data[i];
+		}
+	}
+
+	const double invCount = 1.0 / m_Count;
+	for (uint32_t i = 0; i < numSeries; ++i) {
+		mean[i] *= invCount;
+	}
+
+	for (uint32_t row = 0; row < m_Count; ++row) {
+		const T* data = &m_Data[(size_t)row * numSeries];
+		for (uint32_t i = 0; i < numSeries; ++i) {
+			const double d = (double)data[i] - mean[i];
+			m2[i] += d * d;
+		}
+	}
+}
+
+// ln(2) in double precision (bx::kLogNat2 is a float).
+static const double kLn2 = 0.69314718055994530942;
+
+template<typename T>
+exponential_moving_average<T>::exponential_moving_average(double halfLife) : m_Value(0), m_HalfLife(halfLife), m_LastTime(0.0), m_HasValue(false)
+{
+	JTL_CHECK(halfLife > 0.0, "Invalid half-life");
+}
+
+template<typename T>
+exponential_moving_average<T>::~exponential_moving_average()
+{
+}
+
+template<typename T>
+T exponential_moving_average<T>::insert(T v)
+{
+	return insert(v, m_LastTime + 1.0);
+}
+
+template<typename T>
+T exponential_moving_average<T>::insert(T v, double time)
+{
+	if (!m_HasValue) {
+		m_Value = v;
+		m_HasValue = true;
+	} else {
+		// The old average decays by 2^(-dt / halfLife). expm1() keeps alpha accurate when
+		// dt is tiny compared to the half-life (1 - 2^-x would round to 0).
+		const double dt = bx::max(time - m_LastTime, 0.0);
+		const double alpha = -::expm1(-dt / m_HalfLife * kLn2);
+		m_Value = T(m_Value + (v - m_Value) * alpha);
+	}
+
+	m_LastTime = time;
+	return m_Value;
+}
+
+template<typename T>
+T exponential_moving_average<T>::getAverage() const
+{
+	return m_Value;
+}
+
+template<typename T>
+void exponential_moving_average<T>::reset()
+{
+	m_Value = T(0);
+	m_LastTime = 0.0;
+	m_HasValue = false;
+}
+
+inline exponential_rate::exponential_rate(double halfLife) : m_HalfLife(halfLife), m_Sum(0.0), m_StartTime(0.0), m_LastTime(0.0), m_Started(false)
+{
+	JTL_CHECK(halfLife > 0.0, "Invalid half-life");
+}
+
+inline exponential_rate::~exponential_rate()
+{
+}
+
+inline void exponential_rate::add(double time, double count)
+{
+	if (!m_Started) {
+		m_StartTime = time;
+		m_LastTime = time;
+		m_Started = true;
+	}
+
+	const double dt = bx::max(time - m_LastTime, 0.0);
+	m_Sum = m_Sum * ::exp2(-dt / m_HalfLife) + count;
+	m_LastTime = bx::max(time, m_LastTime);
+}
+
+inline double exponential_rate::getRate(double time) const
+{
+	if (!m_Started) {
+		return 0.0;
+	}
+
+	// Events are weighted by 2^(-age / halfLife), whose integral over the last `elapsed`
+	// units of time is halfLife / ln(2) * (1 - 2^(-elapsed / halfLife)).
+	const double decay = ::exp2(-bx::max(time - m_LastTime, 0.0) / m_HalfLife);
+	const double elapsed = bx::max(time - m_StartTime, 0.0);
+	const double window = -m_HalfLife / kLn2 * ::expm1(-elapsed / m_HalfLife * kLn2);
+	return window > 0.0 ? m_Sum * decay / window : 0.0;
+}
+
+inline void exponential_rate::reset()
+{
+	m_Sum = 0.0;
+	m_StartTime = 0.0;
+	m_LastTime = 0.0;
+	m_Started = false;
+}
+
+template<typename T, uint32_t NumBuckets>
+time_window_average<T, NumBuckets>::time_window_average(double windowDuration) : m_BucketDuration(windowDuration / NumBuckets), m_StartTime(0.0), m_Started(false)
+{
+	JTL_CHECK(windowDuration > 0.0, "Invalid window duration");
+	reset();
+}
+
+template<typename T, uint32_t NumBuckets>
+time_window_average<T, NumBuckets>::~time_window_average()
+{
+}
+
+template<typename T, uint32_t NumBuckets>
+void time_window_average<T, NumBuckets>::insert(T v, double time)
+{
+	if (!m_Started) {
+		m_StartTime = time;
+		m_Started = true;
+	}
+
+	const int64_t index = getBucketIndex(time);
+	Bucket& bucket = m_Buckets[(uint64_t)index % NumBuckets];
+	if (bucket.m_Index != index) {
+		bucket.m_Sum = T(0);
+		bucket.m_Count = 0;
+		bucket.m_Index = index;
+	}
+
+	bucket.m_Sum += v;
+	bucket.m_Count++;
+}
+
+template<typename T, uint32_t NumBuckets>
+void time_window_average<T, NumBuckets>::reset()
+{
+	for (uint32_t i = 0; i < NumBuckets; ++i) {
+		m_Buckets[i].m_Sum = T(0);
+		m_Buckets[i].m_Count = 0;
+		m_Buckets[i].m_Index = INT64_MIN;
+	}
+	m_StartTime = 0.0;
+	m_Started = false;
+}
+
+template<typename T, uint32_t NumBuckets>
+T time_window_average<T, NumBuckets>::getAverage(double time) const
+{
+	T total;
+	uint32_t count;
+	sum(time, total, count);
+	return count ? T(total / count) : T(0);
+}
+
+template<typename T, uint32_t NumBuckets>
+uint32_t time_window_average<T, NumBuckets>::getCount(double time) const
+{
+	T total;
+	uint32_t count;
+	sum(time, total, count);
+	return count;
+}
+
+template<typename T, uint32_t NumBuckets>
+double time_window_average<T, NumBuckets>::getRate(double time) const
+{
+	T total;
+	uint32_t count;
+	sum(time, total, count);
+
+	const double duration = getCoveredDuration(time);
+	return duration > 0.0 ? (double)count / duration : 0.0;
+}
+
+template<typename T, uint32_t NumBuckets>
+double time_window_average<T, NumBuckets>::getSumRate(double time) const
+{
+	T total;
+	uint32_t count;
+	sum(time, total, count);
+
+	const double duration = getCoveredDuration(time);
+	return duration > 0.0 ? (double)total / duration : 0.0;
+}
+
+template<typename T, uint32_t NumBuckets>
+inline int64_t time_window_average<T, NumBuckets>::getBucketIndex(double time) const
+{
+	// Computed in double precision, absolute timestamps don't fit in a float.
+	const double bucket = time / m_BucketDuration;
+	const int64_t index = (int64_t)bucket;
+	return (double)index > bucket ? index - 1 : index;
+}
+
+template<typename T, uint32_t NumBuckets>
+void time_window_average<T, NumBuckets>::sum(double time, T& total, uint32_t& count) const
+{
+	const int64_t last = getBucketIndex(time);
+	total = T(0);
+	count = 0;
+	for (uint32_t i = 0; i < NumBuckets; ++i) {
+		const Bucket& bucket = m_Buckets[i];
+		if (bucket.m_Index > last - (int64_t)NumBuckets && bucket.m_Index <= last) {
+			total += bucket.m_Sum;
+			count += bucket.m_Count;
+		}
+	}
+}
+
+// The window spans NumBuckets buckets, the last one being partially elapsed, and is
+// shorter until enough time has passed since the first sample.
+template<typename T, uint32_t NumBuckets>
+double time_window_average<T, NumBuckets>::getCoveredDuration(double time) const
+{
+	if (!m_Started) {
+		return 0.0;
 	}
 
-	return bx::sqrt(stdDev / m_Count);
+	const double windowStart = (double)(getBucketIndex(time) - (int64_t)NumBuckets + 1) * m_BucketDuration;
+	return time - bx::max(windowStart, m_StartTime);
 }
 }
 
@@ -0,0 +1,76 @@
+#ifndef JTL_POOL_ALLOCATOR_H
+#define JTL_POOL_ALLOCATOR_H
+
+#include <stdint.h>
+#include <bx/allocator.h>
+#include "jtl.h"
+
+namespace jtl
+{
+struct PoolBlock;
+struct PoolThreadCache;
+
+// Size class based small object allocator. Allocations up to kMaxBlockSize bytes (with
+// alignment <= 16) are served from per-thread free lists, which are refilled from and
+// flushed to per-size-class global lists in batches of kBatchSize blocks using lock-free
+// stacks. Larger allocations are forwarded to the backing allocator.
+//
+// Memory is carved out of large chunks allocated from the backing allocator and is only
+// returned to it when the pool is destroyed. The blocks cached by a thread are returned
+// to the global lists when it exits. The pool must outlive all the allocations made from
+// it and must not be destroyed while threads which used it are exiting. At most
+// kMaxPools pools can exist at the same time.
+//
+// Typical use is allocate_shared<T>(getPoolAllocator(), ...) for lots of short-lived
+// shared objects.
+class pool_allocator : public bx::AllocatorI
+{
+public:
+	static const uint32_t kMaxBlockSize = 512;
+	static const uint32_t kBatchSize = 32;
+	static const uint32_t kMaxPools = 16;
+
+	pool_allocator(bx::AllocatorI* backingAllocator = nullptr, uint32_t chunkSize = 64 * 1024);
+	virtual ~pool_allocator();
+
+	virtual void* realloc(void* _ptr, size_t _size, size_t _align, const char* _file, uint32_t _line) override;
+
+	// Returns the blocks cached by the calling thread to the global lists.
+	void flushThreadCache();
+
+	uint32_t getGeneration() const;
+
+private:
+	static const uint32_t kNumSizeClasses = 16;
+
+	bx::AllocatorI* m_BackingAllocator;
+	void* m_Chunks; // Lock-free list of chunks, only traversed when the pool is destroyed
+	uint64_t m_FreeBatches[kNumSizeClasses]; // Tagged pointers to lock-free stacks of batches
+	uint32_t m_ChunkSize;
+	uint32_t m_Slot;
+	uint32_t m_Generation;
+
+	void* allocSmall(uint32_t sizeClass);
+	void freeSmall(PoolBlock* block);
+	void* allocLarge(size_t size, size_t align, const char* file, uint32_t line);
+	void freeLarge(PoolBlock* block, const char* file, uint32_t line);
+	PoolBlock* refill(uint32_t sizeClass, uint32_t& count);
+	PoolBlock* allocChunk(uint32_t sizeClass, uint32_t& count);
+	void pushBatch(uint32_t sizeClass, PoolBlock* batch, uint32_t count);
+	PoolBlock* popBatch(uint32_t sizeClass, uint32_t& count);
+	PoolThreadCache* getThreadCache();
+
+	pool_allocator(const pool_allocator&) = delete;
+	pool_allocator& operator = (const pool_allocator&) = delete;
+};
+
+// Global pool backed by the default allocator.
+bx::AllocatorI* getPoolAllocator();
+
+inline uint32_t pool_allocator::getGeneration() const
+{
+	return m_Generation;
+}
+}
+
+#endif
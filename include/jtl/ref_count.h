@@ -0,0 +1,333 @@
+#ifndef JTL_REF_COUNT_H
+#define JTL_REF_COUNT_H
+
+#include <stdint.h>
+#include <bx/cpu.h>
+#include "jtl.h"
+#include "atomic.h"
+
+namespace jtl
+{
+// Reference counting policies used by shared_ptr and intrusive_ref_count. All policies
+// expose the same interface:
+//
+// - increment()
+// - decrement(), returns true when the count reaches 0
+// - increment_if_not_zero(), returns false if the count already reached 0
+// - get(), returns the current count (approximate when other threads modify it)
+
+// Thread-safe counting using atomic RMW operations. This is the default.
+class atomic_ref_count
+{
+public:
+	explicit atomic_ref_count(int32_t count = 1);
+
+	void increment();
+	bool decrement();
+	bool increment_if_not_zero();
+	int32_t get() const;
+
+private:
+	int32_t m_Count;
+};
+
+// Plain integer counting for objects which are never shared between threads.
+class local_ref_count
+{
+public:
+	explicit local_ref_count(int32_t count = 1);
+
+	void increment();
+	bool decrement();
+	bool increment_if_not_zero();
+	int32_t get() const;
+
+private:
+	int32_t m_Count;
+};
+
+// Biased reference counting (Choi et al., "Biased Reference Counting: Minimizing Atomic
+// Operations in Garbage Collection", PACT 2018). The thread which created the counter
+// (the owner) uses a plain integer and every other thread uses an atomic shared counter.
+// Best for objects which are mostly copied on the thread which created them but can
+// still be shared with (and released by) other threads.
+//
+// A reference created by the owner can be released by another thread, in which case the
+// shared counter goes negative and only the owner can tell whether the total reached 0.
+// Such counters are queued to the owner, which merges them when it calls collect(), and
+// the release callback is called from there if nothing else references the object.
+// Threads creating biased counters should call collect() periodically (e.g. once per
+// frame) and before exiting, and must outlive the counters they create.
+class biased_ref_count
+{
+public:
+	typedef void (*ReleaseFunc)(void* userData);
+
+	explicit biased_ref_count(int32_t count = 1);
+
+	void increment();
+	bool decrement();
+	bool increment_if_not_zero();
+	int32_t get() const;
+
+	// Called by collect() on the owner thread instead of decrement() returning true.
+	void set_release_callback(ReleaseFunc func, void* userData);
+
+	// Merges the counters created by the calling thread which have been queued by other
+	// threads.
+	static void collect();
+
+private:
+	// The shared counter is kept in units of 4. The lowest bit is set once the biased
+	// count has been merged into it (from then on all threads use the shared counter),
+	// and the next bit is set while the counter is queued to the owner.
+	enum : int32_t
+	{
+		kMerged = 1,
+		kQueued = 2,
+		kOne = 4,
+	};
+
+	struct ThreadState
+	{
+		biased_ref_count* m_Queue;
+	};
+
+	ThreadState* m_Owner;
+	int32_t m_Biased;
+	int32_t m_Shared;
+	biased_ref_count* m_NextQueued;
+	ReleaseFunc m_ReleaseFunc;
+	void* m_UserData;
+
+	bool isOwner() const;
+	int32_t loadShared() const;
+	void enqueue();
+
+	static ThreadState* getThreadState();
+};
+
+// Lets owners of counters (e.g. shared_ptr control blocks) get notified when a biased
+// counter drops to 0 outside of decrement(). No-op for the other policies.
+template<typename Policy>
+inline void setReleaseCallback(Policy& /*counter*/, void (*/*func*/)(void*), void* /*userData*/)
+{
+}
+
+inline void setReleaseCallback(biased_ref_count& counter, biased_ref_count::ReleaseFunc func, void* userData)
+{
+	counter.set_release_callback(func, userData);
+}
+
+inline atomic_ref_count::atomic_ref_count(int32_t count)
+	: m_Count(count)
+{
+}
+
+inline void atomic_ref_count::increment()
+{
+	bx::atomicAddAndFetch(&m_Count, 1);
+}
+
+inline bool atomic_ref_count::decrement()
+{
+	JTL_CHECK(get() > 0, "Invalid reference count");
+	return bx::atomicSubAndFetch(&m_Count, 1) == 0;
+}
+
+inline bool atomic_ref_count::increment_if_not_zero()
+{
+	int32_t count = get();
+	while (count != 0) {
+		const int32_t prev = bx::atomicCompareAndSwap(&m_Count, count, count + 1);
+		if (prev == count) {
+			return true;
+		}
+		count = prev;
+	}
+
+	return false;
+}
+
+inline int32_t atomic_ref_count::get() const
+{
+	return atomicLoad(&m_Count);
+}
+
+inline local_ref_count::local_ref_count(int32_t count)
+	: m_Count(count)
+{
+}
+
+inline void local_ref_count::increment()
+{
+	++m_Count;
+}
+
+inline bool local_ref_count::decrement()
+{
+	JTL_CHECK(m_Count > 0, "Invalid reference count");
+	return --m_Count == 0;
+}
+
+inline bool local_ref_count::increment_if_not_zero()
+{
+	if (m_Count == 0) {
+		return false;
+	}
+
+	++m_Count;
+	return true;
+}
+
+inline int32_t local_ref_count::get() const
+{
+	return m_Count;
+}
+
+// A counter created with a count of 0 doesn't have an owner yet. The first thread to
+// increment it becomes the owner.
+inline biased_ref_count::biased_ref_count(int32_t count)
+	: m_Owner(count ? getThreadState() : nullptr)
+	, m_Biased(count)
+	, m_Shared(0)
+	, m_NextQueued(nullptr)
+	, m_ReleaseFunc(nullptr)
+	, m_UserData(nullptr)
+{
+}
+
+inline void biased_ref_count::increment()
+{
+	// m_Biased is only ever touched by the owner and once it drops to 0 it has been
+	// merged, so the owner has to use the shared counter as well.
+	if (isOwner() && m_Biased > 0) {
+		++m_Biased;
+	} else if (!m_Owner) {
+		// First reference. Nobody else can see the object yet.
+		m_Owner = getThreadState();
+		m_Biased = 1;
+	} else {
+		bx::atomicAddAndFetch(&m_Shared, (int32_t)kOne);
+	}
+}
+
+inline bool biased_ref_count::decrement()
+{
+	if (isOwner() && m_Biased > 0) {
+		if (--m_Biased != 0) {
+			return false;
+		}
+
+		// Merge. Since the biased count is 0, the shared counter holds the total count,
+		// which can't be negative. If the counter is queued, collect() takes care of it.
+		return bx::atomicAddAndFetch(&m_Shared, (int32_t)kMerged) == kMerged;
+	}
+
+	int32_t shared = loadShared();
+	for (;;) {
+		int32_t newShared = shared - kOne;
+		const bool enqueue = (newShared & (kMerged | kQueued)) == 0 && newShared < 0;
+		if (enqueue) {
+			newShared |= kQueued;
+		}
+
+		const int32_t prev = bx::atomicCompareAndSwap(&m_Shared, shared, newShared);
+		if (prev == shared) {
+			if (enqueue) {
+				this->enqueue();
+			}
+
+			return newShared == kMerged;
+		}
+		shared = prev;
+	}
+}
+
+inline bool biased_ref_count::increment_if_not_zero()
+{
+	if (isOwner() && m_Biased > 0) {
+		++m_Biased;
+		return true;
+	}
+
+	// Before the merge the owner holds a biased reference so the object is alive.
+	int32_t shared = loadShared();
+	while ((shared & kMerged) == 0 || (shared >> 2) != 0) {
+		const int32_t prev = bx::atomicCompareAndSwap(&m_Shared, shared, shared + kOne);
+		if (prev == shared) {
+			return true;
+		}
+		shared = prev;
+	}
+
+	return false;
+}
+
+inline int32_t biased_ref_count::get() const
+{
+	return atomicLoad(&m_Biased) + (loadShared() >> 2);
+}
+
+inline void biased_ref_count::set_release_callback(ReleaseFunc func, void* userData)
+{
+	m_ReleaseFunc = func;
+	m_UserData = userData;
+}
+
+inline void biased_ref_count::collect()
+{
+	ThreadState* state = getThreadState();
+	if (!atomicLoad(&state->m_Queue)) {
+		return;
+	}
+
+	biased_ref_count* counter = atomicExchangePtr(&state->m_Queue, (biased_ref_count*)nullptr);
+	while (counter) {
+		biased_ref_count* next = counter->m_NextQueued;
+
+		// Merge the biased count (if that hasn't already happened) and unqueue.
+		const int32_t biased = counter->m_Biased;
+		counter->m_Biased = 0;
+
+		const int32_t delta = biased * kOne - kQueued + (biased != 0 ? kMerged : 0);
+		if (bx::atomicAddAndFetch(&counter->m_Shared, delta) == kMerged && counter->m_ReleaseFunc) {
+			counter->m_ReleaseFunc(counter->m_UserData);
+		}
+
+		counter = next;
+	}
+}
+
+inline bool biased_ref_count::isOwner() const
+{
+	return m_Owner == getThreadState();
+}
+
+inline int32_t biased_ref_count::loadShared() const
+{
+	return atomicLoad(&m_Shared);
+}
+
+inline void biased_ref_count::enqueue()
+{
+	ThreadState* owner = m_Owner;
+	biased_ref_count* head = atomicLoad(&owner->m_Queue);
+	for (;;) {
+		m_NextQueued = head;
+		biased_ref_count* prev = atomicCompareAndSwapPtr(&owner->m_Queue, head, this);
+		if (prev == head) {
+			break;
+		}
+		head = prev;
+	}
+}
+
+inline biased_ref_count::ThreadState* biased_ref_count::getThreadState()
+{
+	static thread_local ThreadState s_State = { nullptr };
+	return &s_State;
+}
+}
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef JTL_ROPE_H
+#define JTL_ROPE_H
+
+#include <stdint.h>
+#include <bx/allocator.h>
+#include <bx/string.h>
+#include "jtl.h"
+#include "string.h"
+
+namespace jtl
+{
+struct RopeNode;
+
+// Immutable, reference counted tree of text chunks. Concatenation, insertion, erasure and
+// slicing create O(log n) new nodes and share everything else (including the leaves' text)
+// with the original, so copies are O(1) and edits don't move the rest of the text. The tree
+// is kept height-balanced (AVL) by joining subtrees based on their heights.
+//
+// Nodes are reference counted atomically so ropes sharing nodes can be used from different
+// threads. A single rope object isn't thread-safe.
+class rope
+{
+public:
+	rope(bx::AllocatorI* allocator = nullptr);
+	explicit rope(const char* str, bx::AllocatorI* allocator = nullptr);
+	explicit rope(const char* str, uint32_t len, bx::AllocatorI* allocator = nullptr);
+	explicit rope(const string& str, bx::AllocatorI* allocator = nullptr);
+	rope(const rope& other);
+	rope(rope&& other);
+	~rope();
+
+	rope& operator = (const rope& other);
+	rope& operator = (rope&& other);
+
+	uint32_t size() const;
+	bool empty() const;
+	char operator [] (uint32_t index) const;
+
+	void append(const char* str);
+	void append(const char* str, uint32_t len);
+	void append(const rope& other);
+	void insert(uint32_t pos, const char* str);
+	void insert(uint32_t pos, const char* str, uint32_t len);
+	void insert(uint32_t pos, const rope& other);
+	void erase(uint32_t first, uint32_t last);
+	void clear();
+
+	rope substr(uint32_t first, uint32_t last) const;
+
+	// Copies the characters in [first, last) to dst (no null terminator).
+	void copy(char* dst, uint32_t first, uint32_t last) const;
+	string flatten() const;
+
+	// Calls func(const bx::StringView&) for each chunk of text, in order, without
+	// copying anything.
+	template<typename FuncT>
+	void for_each_chunk(FuncT func) const;
+
+	template<typename FuncT>
+	void for_each_chunk(uint32_t first, uint32_t last, FuncT func) const;
+
+	void swap(rope& other);
+
+private:
+	typedef void (*ChunkCallback)(void* userData, const bx::StringView& chunk);
+
+	RopeNode* m_Root;
+	bx::AllocatorI* m_Allocator;
+
+	explicit rope(RopeNode* root, bx::AllocatorI* allocator);
+
+	void forEachChunk(uint32_t first, uint32_t last, ChunkCallback callback, void* userData) const;
+
+	template<typename FuncT>
+	static void chunkStub(void* userData, const bx::StringView& chunk);
+};
+
+inline rope::rope(bx::AllocatorI* allocator)
+	: m_Root(nullptr)
+	, m_Allocator(allocator ? allocator : getDefaultAllocator())
+{
+}
+
+inline rope::rope(RopeNode* root, bx::AllocatorI* allocator)
+	: m_Root(root)
+	, m_Allocator(allocator)
+{
+}
+
+inline rope::rope(rope&& other)
+	: m_Root(other.m_Root)
+	, m_Allocator(other.m_Allocator)
+{
+	other.m_Root = nullptr;
+}
+
+inline rope& rope::operator = (rope&& other)
+{
+	if (&other != this) {
+		rope(static_cast<rope&&>(other)).swap(*this);
+	}
+
+	return *this;
+}
+
+inline bool rope::empty() const
+{
+	return size() == 0;
+}
+
+inline void rope::append(const char* str)
+{
+	append(str, bx::strLen(str));
+}
+
+inline void rope::insert(uint32_t pos, const char* str)
+{
+	insert(pos, str, bx::strLen(str));
+}
+
+inline void rope::swap(rope& other)
+{
+	RopeNode* const root = other.m_Root;
+	other.m_Root = m_Root;
+	m_Root = root;
+
+	bx::AllocatorI* const allocator = other.m_Allocator;
+	other.m_Allocator = m_Allocator;
+	m_Allocator = allocator;
+}
+
+template<typename FuncT>
+inline void rope::chunkStub(void* userData, const bx::StringView& chunk)
+{
+	FuncT* func = static_cast<FuncT*>(userData);
+	(*func)(chunk);
+}
+
+template<typename FuncT>
+inline void rope::for_each_chunk(FuncT func) const
+{
+	forEachChunk(0, size(), chunkStub<FuncT>, &func);
+}
+
+template<typename FuncT>
+inline void rope::for_each_chunk(uint32_t first, uint32_t last, FuncT func) const
+{
+	forEachChunk(first, last, chunkStub<FuncT>, &func);
+}
+}
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef JTL_SCHEDULER_H
+#define JTL_SCHEDULER_H
+
+#include <stdint.h>
+#include <bx/allocator.h>
+#include "jtl.h"
+
+#include <utility> // std::forward
+#include <type_traits> // std::decay
+
+namespace jtl
+{
+struct SchedulerWorker;
+struct SchedulerState;
+
+// Intrusive unit of work. m_Execute is called once on a worker thread and owns the task
+// from then on (e.g. frees it or hands it back to its owner).
+struct scheduler_task
+{
+	scheduler_task* m_Next;
+	void (*m_Execute)(scheduler_task* task);
+};
+
+// Work-stealing thread pool. Every worker owns a bounded Chase-Lev deque: tasks
+// submitted from a worker are pushed to the bottom of its own deque and popped from
+// there (LIFO, cache friendly), while idle workers steal from the top of other deques.
+// Tasks submitted from other threads, or when a deque is full, go to a shared injection
+// queue. Idle workers spin briefly and then sleep until new tasks arrive.
+//
+// Destroying the scheduler runs all the pending tasks before joining the workers.
+class scheduler
+{
+public:
+	static const uint32_t kDequeCapacity = 4096;
+
+	// numWorkers = 0 creates one worker per hardware thread.
+	scheduler(uint32_t numWorkers = 0, bx::AllocatorI* allocator = nullptr);
+	~scheduler();
+
+	void submit(scheduler_task* task);
+
+	// Allocates a task holding func from the scheduler's allocator and submits it.
+	template<typename FUNC>
+	void run(FUNC&& func);
+
+	// Runs one pending task on the calling thread, if any. Useful for helping out while
+	// waiting on other tasks instead of blocking a worker.
+	bool tryRunOne();
+
+	bool isWorkerThread() const;
+	uint32_t getNumWorkers() const;
+	bx::AllocatorI* getAllocator() const;
+
+private:
+	template<typename FUNC>
+	struct FunctionTask : public scheduler_task
+	{
+		bx::AllocatorI* m_Allocator;
+		FUNC m_Func;
+
+		template<typename F>
+		FunctionTask(bx::AllocatorI* allocator, F&& func)
+			: m_Allocator(allocator)
+			, m_Func(std::forward<F>(func))
+		{
+			m_Next = nullptr;
+			m_Execute = execute;
+		}
+
+		static void execute(scheduler_task* task)
+		{
+			FunctionTask* self = static_cast<FunctionTask*>(task);
+			self->m_Func();
+
+			bx::AllocatorI* allocator = self->m_Allocator;
+			BX_DELETE(allocator, self);
+		}
+	};
+
+	bx::AllocatorI* m_Allocator;
+	SchedulerState* m_State;
+	SchedulerWorker* m_Workers;
+	uint32_t m_NumWorkers;
+
+	scheduler_task* findTask(SchedulerWorker* worker);
+	void workerMain(SchedulerWorker* worker);
+	void wakeWorker();
+
+	scheduler(const scheduler&) = delete;
+	scheduler& operator = (const scheduler&) = delete;
+};
+
+// Global scheduler with one worker per hardware thread, allocating tasks from the pool
+// allocator. Never destroyed.
+scheduler* getDefaultScheduler();
+
+// Returns the scheduler the calling thread is a worker of, or nullptr.
+scheduler* getCurrentScheduler();
+
+template<typename FUNC>
+inline void scheduler::run(FUNC&& func)
+{
+	typedef FunctionTask<typename std::decay<FUNC>::type> TaskT;
+
+	void* mem = BX_ALLOC(m_Allocator, sizeof(TaskT));
+	JTL_CHECK(mem, "Allocation failed");
+	TaskT* task = BX_PLACEMENT_NEW(mem, TaskT)(m_Allocator, std::forward<FUNC>(func));
+	submit(task);
+}
+
+inline uint32_t scheduler::getNumWorkers() const
+{
+	return m_NumWorkers;
+}
+
+inline bx::AllocatorI* scheduler::getAllocator() const
+{
+	return m_Allocator;
+}
+}
+
+#endif
@@ -5,48 +5,170 @@
 #include <bx/allocator.h>
 #include <bx/cpu.h>
 #include "jtl.h"
+#include "ref_count.h"
 
 #include <utility> // std::forward
-#include <type_traits> // std::aligned_storage
+#include <type_traits> // std::aligned_storage, std::enable_if, std::is_convertible
 
 namespace jtl
 {
-template<typename T>
-struct RefCount
+// Control block shared by all shared_ptrs/weak_ptrs to the same object. The object is
+// destroyed when the strong count drops to 0 and the control block is freed when the
+// weak count drops to 0. All strong references together hold a single weak reference.
+// Policy is one of the reference counting policies from ref_count.h.
+template<typename Policy>
+struct RefCountBase
+{
+	Policy m_StrongCount;
+	Policy m_WeakCount;
+
+	RefCountBase()
+		: m_StrongCount(1)
+		, m_WeakCount(1)
+	{
+		setReleaseCallback(m_StrongCount, strongReleased, this);
+		setReleaseCallback(m_WeakCount, weakReleased, this);
+	}
+
+	virtual ~RefCountBase()
+	{
+	}
+
+	// Destroys the managed object.
+	virtual void destroy() = 0;
+
+	// Frees the control block (and the object's memory in case it's embedded in it).
+	virtual void deallocate() = 0;
+
+	void addRef()
+	{
+		m_StrongCount.increment();
+	}
+
+	void release()
+	{
+		if (m_StrongCount.decrement()) {
+			destroy();
+			releaseWeak();
+		}
+	}
+
+	// Increments the strong count only if the object is still alive.
+	bool addRefIfNotZero()
+	{
+		return m_StrongCount.increment_if_not_zero();
+	}
+
+	void addWeakRef()
+	{
+		m_WeakCount.increment();
+	}
+
+	void releaseWeak()
+	{
+		if (m_WeakCount.decrement()) {
+			deallocate();
+		}
+	}
+
+	int32_t getCount() const
+	{
+		return m_StrongCount.get();
+	}
+
+	static void strongReleased(void* userData)
+	{
+		RefCountBase* refCount = static_cast<RefCountBase*>(userData);
+		refCount->destroy();
+		refCount->releaseWeak();
+	}
+
+	static void weakReleased(void* userData)
+	{
+		static_cast<RefCountBase*>(userData)->deallocate();
+	}
+};
+
+// Control block with the object embedded in it (allocate_shared/make_shared).
+template<typename T, typename Policy = atomic_ref_count>
+struct RefCount : public RefCountBase<Policy>
 {
 	typedef typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type StorageT;
 
 	StorageT m_Memory;
 	bx::AllocatorI* m_Allocator;
-	int m_Count;
 
 	template <typename... Args>
 	RefCount(bx::AllocatorI* allocator, Args&&... args)
 		: m_Allocator(allocator)
-		, m_Count(1)
 	{
 		BX_PLACEMENT_NEW(&m_Memory, T)(std::forward<Args>(args)...);
 	}
 
-	void addRef()
+	T* getObject()
 	{
-		bx::atomicAddAndFetch(&m_Count, 1);
+		return static_cast<T*>(static_cast<void*>(&m_Memory));
 	}
 
-	void release()
+	virtual void destroy()
 	{
-		JTL_CHECK(m_Count > 0, "Invalid reference count");
-		if (bx::atomicSubAndFetch(&m_Count, 1) == 0) {
-			T* inst = static_cast<T*>(static_cast<void*>(&m_Memory));
-			inst->~T();
+		getObject()->~T();
+	}
 
-			bx::AllocatorI* allocator = m_Allocator;
-			BX_FREE(allocator, this);
-		}
+	virtual void deallocate()
+	{
+		bx::AllocatorI* allocator = m_Allocator;
+		this->~RefCount();
+		BX_FREE(allocator, this);
+	}
+};
+
+// Control block for an adopted pointer which is released by calling deleter(ptr).
+template<typename T, typename DeleterT, typename Policy = atomic_ref_count>
+struct RefCountPtr : public RefCountBase<Policy>
+{
+	T* m_Ptr;
+	DeleterT m_Deleter;
+	bx::AllocatorI* m_Allocator;
+
+	RefCountPtr(T* ptr, DeleterT deleter, bx::AllocatorI* allocator)
+		: m_Ptr(ptr)
+		, m_Deleter(static_cast<DeleterT&&>(deleter))
+		, m_Allocator(allocator)
+	{
+	}
+
+	virtual void destroy()
+	{
+		m_Deleter(m_Ptr);
+	}
+
+	virtual void deallocate()
+	{
+		bx::AllocatorI* allocator = m_Allocator;
+		this->~RefCountPtr();
+		BX_FREE(allocator, this);
+	}
+};
+
+template<typename T>
+struct default_delete
+{
+	void operator() (T* ptr) const
+	{
+		delete ptr;
 	}
 };
 
+template<typename T, typename Policy = atomic_ref_count>
+class weak_ptr;
+
 template<typename T>
+class atomic_shared_ptr;
+
+// Policy selects how the reference counts are updated (see ref_count.h). shared_ptrs
+// with different policies can't be converted to each other.
+template<typename T, typename Policy = atomic_ref_count>
 class shared_ptr
 {
 public:
@@ -56,31 +178,102 @@ public:
 	shared_ptr(std::nullptr_t);
 	~shared_ptr();
 
+	// Takes ownership of ptr, which is released with deleter(ptr) once the last reference
+	// goes away. The control block is allocated from the specified allocator. If the
+	// allocation fails, ptr is released immediately and the shared_ptr is left empty.
+	template<typename U, typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+	explicit shared_ptr(U* ptr);
+
+	template<typename U, typename DeleterT, typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+	shared_ptr(U* ptr, DeleterT deleter, bx::AllocatorI* allocator = nullptr);
+
+	// Converting constructors (e.g. shared_ptr<Derived> -> shared_ptr<Base>)
+	template<typename U, typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+	shared_ptr(const shared_ptr<U, Policy>& other);
+
+	template<typename U, typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+	shared_ptr(shared_ptr<U, Policy>&& other);
+
+	// Aliasing constructor: shares ownership with other but points to ptr (e.g. a member
+	// of the object owned by other).
+	template<typename U>
+	shared_ptr(const shared_ptr<U, Policy>& other, T* ptr);
+
+	T* get() const;
 	T* operator -> () const;
+	T& operator * () const;
 
 	operator bool() const;
 
-	shared_ptr<T>& operator = (const shared_ptr<T>& other);
-	shared_ptr<T>& operator = (shared_ptr<T>&& other);
-	void swap(shared_ptr<T>& other);
+	int32_t use_count() const;
+
+	shared_ptr<T, Policy>& operator = (const shared_ptr<T, Policy>& other);
+	shared_ptr<T, Policy>& operator = (shared_ptr<T, Policy>&& other);
+	void swap(shared_ptr<T, Policy>& other);
+	void reset();
 
 protected:
-	template <typename R>
-	friend void allocate_shared_helper(shared_ptr<R>&, RefCount<R>*, R*);
+	template <typename R, typename P>
+	friend void allocate_shared_helper(shared_ptr<R, P>&, RefCountBase<P>*, R*);
+
+	template<typename U, typename P>
+	friend class shared_ptr;
+
+	template<typename U, typename P>
+	friend class weak_ptr;
+
+	template<typename U>
+	friend class atomic_shared_ptr;
 
 	T* m_Value;
-	RefCount<T>* m_RefCount;
+	RefCountBase<Policy>* m_RefCount;
 };
 
-template<typename T>
-inline shared_ptr<T>::shared_ptr()
+// Non-owning reference to an object managed by shared_ptr. Use lock() to get a
+// shared_ptr to the object if it's still alive.
+template<typename T, typename Policy>
+class weak_ptr
+{
+public:
+	weak_ptr();
+	weak_ptr(const weak_ptr& other);
+	weak_ptr(weak_ptr&& other);
+	weak_ptr(std::nullptr_t);
+	~weak_ptr();
+
+	template<typename U, typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+	weak_ptr(const shared_ptr<U, Policy>& other);
+
+	template<typename U, typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+	weak_ptr(const weak_ptr<U, Policy>& other);
+
+	weak_ptr<T, Policy>& operator = (const weak_ptr<T, Policy>& other);
+	weak_ptr<T, Policy>& operator = (weak_ptr<T, Policy>&& other);
+
+	shared_ptr<T, Policy> lock() const;
+	bool expired() const;
+	int32_t use_count() const;
+
+	void swap(weak_ptr<T, Policy>& other);
+	void reset();
+
+private:
+	template<typename U, typename P>
+	friend class weak_ptr;
+
+	T* m_Value;
+	RefCountBase<Policy>* m_RefCount;
+};
+
+template<typename T, typename Policy>
+inline shared_ptr<T, Policy>::shared_ptr()
 	: m_Value(nullptr)
 	, m_RefCount(nullptr)
 {
 }
 
-template<typename T>
-inline shared_ptr<T>::shared_ptr(const shared_ptr<T>& other)
+template<typename T, typename Policy>
+inline shared_ptr<T, Policy>::shared_ptr(const shared_ptr<T, Policy>& other)
 	: m_Value(other.m_Value)
 	, m_RefCount(other.m_RefCount)
 {
@@ -89,8 +282,8 @@ inline shared_ptr<T>::shared_ptr(const shared_ptr<T>& other)
 	}
 }
 
-template<typename T>
-inline shared_ptr<T>::shared_ptr(shared_ptr<T>&& other)
+template<typename T, typename Policy>
+inline shared_ptr<T, Policy>::shared_ptr(shared_ptr<T, Policy>&& other)
 	: m_Value(other.m_Value)
 	, m_RefCount(other.m_RefCount)
 {
@@ -98,98 +291,340 @@ inline shared_ptr<T>::shared_ptr(shared_ptr<T>&& other)
 	other.m_RefCount = nullptr;
 }
 
-template<typename T>
-inline shared_ptr<T>::shared_ptr(std::nullptr_t)
+template<typename T, typename Policy>
+inline shared_ptr<T, Policy>::shared_ptr(std::nullptr_t)
 	: m_Value(nullptr)
 	, m_RefCount(nullptr)
 {
 }
 
-template<typename T>
-inline shared_ptr<T>::~shared_ptr()
+template<typename T, typename Policy>
+template<typename U, typename>
+inline shared_ptr<T, Policy>::shared_ptr(U* ptr)
+	: shared_ptr(ptr, default_delete<U>(), nullptr)
+{
+}
+
+template<typename T, typename Policy>
+template<typename U, typename DeleterT, typename>
+inline shared_ptr<T, Policy>::shared_ptr(U* ptr, DeleterT deleter, bx::AllocatorI* allocator)
+	: m_Value(nullptr)
+	, m_RefCount(nullptr)
+{
+	if (!ptr) {
+		return;
+	}
+
+	typedef RefCountPtr<U, DeleterT, Policy> RefCountT;
+
+	allocator = allocator ? allocator : getDefaultAllocator();
+	void* mem = BX_ALLOC(allocator, sizeof(RefCountT));
+	if (!mem) {
+		deleter(ptr);
+		return;
+	}
+
+	m_RefCount = BX_PLACEMENT_NEW(mem, RefCountT)(ptr, static_cast<DeleterT&&>(deleter), allocator);
+	m_Value = ptr;
+}
+
+template<typename T, typename Policy>
+template<typename U, typename>
+inline shared_ptr<T, Policy>::shared_ptr(const shared_ptr<U, Policy>& other)
+	: m_Value(other.m_Value)
+	, m_RefCount(other.m_RefCount)
+{
+	if (m_RefCount) {
+		m_RefCount->addRef();
+	}
+}
+
+template<typename T, typename Policy>
+template<typename U, typename>
+inline shared_ptr<T, Policy>::shared_ptr(shared_ptr<U, Policy>&& other)
+	: m_Value(other.m_Value)
+	, m_RefCount(other.m_RefCount)
+{
+	other.m_Value = nullptr;
+	other.m_RefCount = nullptr;
+}
+
+template<typename T, typename Policy>
+template<typename U>
+inline shared_ptr<T, Policy>::shared_ptr(const shared_ptr<U, Policy>& other, T* ptr)
+	: m_Value(ptr)
+	, m_RefCount(other.m_RefCount)
+{
+	if (m_RefCount) {
+		m_RefCount->addRef();
+	}
+}
+
+template<typename T, typename Policy>
+inline shared_ptr<T, Policy>::~shared_ptr()
 {
 	if (m_RefCount) {
 		m_RefCount->release();
 	}
 }
 
-template<typename T>
-inline T* shared_ptr<T>::operator->() const
+template<typename T, typename Policy>
+inline T* shared_ptr<T, Policy>::get() const
 {
 	return m_Value;
 }
 
-template<typename T>
-inline shared_ptr<T>::operator bool() const
+template<typename T, typename Policy>
+inline T* shared_ptr<T, Policy>::operator->() const
+{
+	return m_Value;
+}
+
+template<typename T, typename Policy>
+inline T& shared_ptr<T, Policy>::operator*() const
+{
+	return *m_Value;
+}
+
+template<typename T, typename Policy>
+inline shared_ptr<T, Policy>::operator bool() const
 {
 	return m_Value != nullptr;
 }
 
-template<typename T>
-inline shared_ptr<T>& shared_ptr<T>::operator=(const shared_ptr<T>& other)
+template<typename T, typename Policy>
+inline int32_t shared_ptr<T, Policy>::use_count() const
+{
+	return m_RefCount ? m_RefCount->getCount() : 0;
+}
+
+template<typename T, typename Policy>
+inline shared_ptr<T, Policy>& shared_ptr<T, Policy>::operator=(const shared_ptr<T, Policy>& other)
 {
 	if (&other != this) {
-		shared_ptr<T>(other).swap(*this);
+		shared_ptr<T, Policy>(other).swap(*this);
 	}
 
 	return *this;
 }
 
-template<typename T>
-inline shared_ptr<T>& shared_ptr<T>::operator=(shared_ptr<T>&& other)
+template<typename T, typename Policy>
+inline shared_ptr<T, Policy>& shared_ptr<T, Policy>::operator=(shared_ptr<T, Policy>&& other)
 {
 	if (&other != this) {
-		shared_ptr<T>(std::move(other)).swap(*this);
+		shared_ptr<T, Policy>(std::move(other)).swap(*this);
 	}
 
 	return *this;
 }
 
-template<typename T>
-inline void shared_ptr<T>::swap(shared_ptr<T>& other)
+template<typename T, typename Policy>
+inline void shared_ptr<T, Policy>::swap(shared_ptr<T, Policy>& other)
+{
+	T* const value = other.m_Value;
+	other.m_Value = m_Value;
+	m_Value = value;
+
+	RefCountBase<Policy>* const refCount = other.m_RefCount;
+	other.m_RefCount = m_RefCount;
+	m_RefCount = refCount;
+}
+
+template<typename T, typename Policy>
+inline void shared_ptr<T, Policy>::reset()
+{
+	shared_ptr<T, Policy>().swap(*this);
+}
+
+template<typename T, typename U, typename Policy>
+inline bool operator == (const shared_ptr<T, Policy>& a, const shared_ptr<U, Policy>& b)
+{
+	return a.get() == b.get();
+}
+
+template<typename T, typename U, typename Policy>
+inline bool operator != (const shared_ptr<T, Policy>& a, const shared_ptr<U, Policy>& b)
+{
+	return a.get() != b.get();
+}
+
+template<typename T, typename Policy>
+inline weak_ptr<T, Policy>::weak_ptr()
+	: m_Value(nullptr)
+	, m_RefCount(nullptr)
+{
+}
+
+template<typename T, typename Policy>
+inline weak_ptr<T, Policy>::weak_ptr(const weak_ptr<T, Policy>& other)
+	: m_Value(other.m_Value)
+	, m_RefCount(other.m_RefCount)
+{
+	if (m_RefCount) {
+		m_RefCount->addWeakRef();
+	}
+}
+
+template<typename T, typename Policy>
+inline weak_ptr<T, Policy>::weak_ptr(weak_ptr<T, Policy>&& other)
+	: m_Value(other.m_Value)
+	, m_RefCount(other.m_RefCount)
+{
+	other.m_Value = nullptr;
+	other.m_RefCount = nullptr;
+}
+
+template<typename T, typename Policy>
+inline weak_ptr<T, Policy>::weak_ptr(std::nullptr_t)
+	: m_Value(nullptr)
+	, m_RefCount(nullptr)
+{
+}
+
+template<typename T, typename Policy>
+template<typename U, typename>
+inline weak_ptr<T, Policy>::weak_ptr(const shared_ptr<U, Policy>& other)
+	: m_Value(other.m_Value)
+	, m_RefCount(other.m_RefCount)
+{
+	if (m_RefCount) {
+		m_RefCount->addWeakRef();
+	}
+}
+
+template<typename T, typename Policy>
+template<typename U, typename>
+inline weak_ptr<T, Policy>::weak_ptr(const weak_ptr<U, Policy>& other)
+	: m_Value(nullptr)
+	, m_RefCount(nullptr)
+{
+	// Converting the pointer might require reading the vtable of the object (virtual
+	// inheritance), so go through a strong reference in order to make sure it's alive.
+	shared_ptr<U, Policy> locked = other.lock();
+	if (locked) {
+		m_Value = locked.m_Value;
+		m_RefCount = locked.m_RefCount;
+		m_RefCount->addWeakRef();
+	}
+}
+
+template<typename T, typename Policy>
+inline weak_ptr<T, Policy>::~weak_ptr()
+{
+	if (m_RefCount) {
+		m_RefCount->releaseWeak();
+	}
+}
+
+template<typename T, typename Policy>
+inline weak_ptr<T, Policy>& weak_ptr<T, Policy>::operator=(const weak_ptr<T, Policy>& other)
+{
+	if (&other != this) {
+		weak_ptr<T, Policy>(other).swap(*this);
+	}
+
+	return *this;
+}
+
+template<typename T, typename Policy>
+inline weak_ptr<T, Policy>& weak_ptr<T, Policy>::operator=(weak_ptr<T, Policy>&& other)
+{
+	if (&other != this) {
+		weak_ptr<T, Policy>(std::move(other)).swap(*this);
+	}
+
+	return *this;
+}
+
+template<typename T, typename Policy>
+inline shared_ptr<T, Policy> weak_ptr<T, Policy>::lock() const
+{
+	shared_ptr<T, Policy> ret;
+	if (m_RefCount && m_RefCount->addRefIfNotZero()) {
+		ret.m_Value = m_Value;
+		ret.m_RefCount = m_RefCount;
+	}
+
+	return ret;
+}
+
+template<typename T, typename Policy>
+inline bool weak_ptr<T, Policy>::expired() const
+{
+	return use_count() == 0;
+}
+
+template<typename T, typename Policy>
+inline int32_t weak_ptr<T, Policy>::use_count() const
+{
+	return m_RefCount ? m_RefCount->getCount() : 0;
+}
+
+template<typename T, typename Policy>
+inline void weak_ptr<T, Policy>::swap(weak_ptr<T, Policy>& other)
 {
 	T* const value = other.m_Value;
 	other.m_Value = m_Value;
 	m_Value = value;
 
-	RefCount<T>* const refCount = other.m_RefCount;
+	RefCountBase<Policy>* const refCount = other.m_RefCount;
 	other.m_RefCount = m_RefCount;
 	m_RefCount = refCount;
 }
 
-template <typename R>
-inline void allocate_shared_helper(shared_ptr<R>& sharedPtr, RefCount<R>* refCount, R* value)
+template<typename T, typename Policy>
+inline void weak_ptr<T, Policy>::reset()
+{
+	weak_ptr<T, Policy>().swap(*this);
+}
+
+template <typename R, typename Policy>
+inline void allocate_shared_helper(shared_ptr<R, Policy>& sharedPtr, RefCountBase<Policy>* refCount, R* value)
 {
 	sharedPtr.m_RefCount = refCount;
 	sharedPtr.m_Value = value;
 }
 
-template <typename T, typename... Args>
-inline shared_ptr<T> allocate_shared(bx::AllocatorI* allocator, Args&&... args)
+template <typename T, typename Policy = atomic_ref_count, typename... Args>
+inline shared_ptr<T, Policy> allocate_shared(bx::AllocatorI* allocator, Args&&... args)
 {
-	typedef RefCount<T> RefCountT;
+	typedef RefCount<T, Policy> RefCountT;
 
-	shared_ptr<T> ret;
+	shared_ptr<T, Policy> ret;
 	void* mem = BX_ALLOC(allocator, sizeof(RefCountT));
 	if (mem) {
 		RefCountT* refCount = BX_PLACEMENT_NEW(mem, RefCountT)(allocator, std::forward<Args>(args)...);
-		allocate_shared_helper(ret, refCount, static_cast<T*>(static_cast<void*>(&refCount->m_Memory)));
+		allocate_shared_helper(ret, refCount, refCount->getObject());
 	}
 
 	return ret;
 }
 
-template <typename T, typename... Args>
-inline shared_ptr<T> make_shared(Args&&... args)
+template <typename T, typename Policy = atomic_ref_count, typename... Args>
+inline shared_ptr<T, Policy> make_shared(Args&&... args)
 {
-	return allocate_shared<T>(getDefaultAllocator(), std::forward<Args>(args)...);
+	return allocate_shared<T, Policy>(getDefaultAllocator(), std::forward<Args>(args)...);
 }
 
-template <typename T, typename... Args>
-inline shared_ptr<T> make_shared(bx::AllocatorI* allocator, Args&&... args)
+template <typename T, typename Policy = atomic_ref_count, typename... Args>
+inline shared_ptr<T, Policy> make_shared(bx::AllocatorI* allocator, Args&&... args)
 {
-	return allocate_shared<T>(allocator, std::forward<Args>(args)...);
+	return allocate_shared<T, Policy>(allocator, std::forward<Args>(args)...);
 }
+
+// Shorthands for shared_ptrs to objects which never leave the thread that created them
+// (no atomic operations) and to objects mostly copied on that thread (biased counting).
+template<typename T>
+using local_shared_ptr = shared_ptr<T, local_ref_count>;
+
+template<typename T>
+using local_weak_ptr = weak_ptr<T, local_ref_count>;
+
+template<typename T>
+using biased_shared_ptr = shared_ptr<T, biased_ref_count>;
+
+template<typename T>
+using biased_weak_ptr = weak_ptr<T, biased_ref_count>;
 }
 
 #endif
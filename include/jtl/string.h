@@ -4,11 +4,52 @@
 #include <stdint.h>
 #include <bx/allocator.h>
 #include <bx/string.h>
-#include <ctype.h> // tolower()
 #include "jtl.h"
 
 namespace jtl
 {
+// ASCII-only case conversion (src and dst may alias). Bytes outside [A-Za-z] are
+// copied unchanged. Unlike ::tolower() this doesn't depend on the current locale.
+void ascii_tolower(char* dst, const char* src, uint32_t len);
+void ascii_toupper(char* dst, const char* src, uint32_t len);
+
+// ASCII case-insensitive comparison. compare_nocase() returns <0, 0 or >0 like strcmp().
+bool equal_nocase(const char* a, uint32_t lenA, const char* b, uint32_t lenB);
+int32_t compare_nocase(const char* a, uint32_t lenA, const char* b, uint32_t lenB);
+
+// fnv1a() over the ASCII-lowercased bytes.
+uint32_t fnv1a_nocase(const void* buffer, uint32_t len);
+
+// Maximum number of characters written by to_chars() for each type.
+static const uint32_t kMaxCharsInt32 = 11;
+static const uint32_t kMaxCharsUInt32 = 10;
+static const uint32_t kMaxCharsInt64 = 20;
+static const uint32_t kMaxCharsUInt64 = 20;
+static const uint32_t kMaxCharsFloat = 16;
+static const uint32_t kMaxCharsDouble = 24;
+
+// Locale-independent number formatting (no null terminator is written). Returns the
+// number of characters written or 0 if the buffer is too small.
+// Floats and doubles are written using the shortest representation which round-trips through
+// from_chars(), in fixed notation for exponents in [-4, 9) and scientific otherwise.
+uint32_t to_chars(char* buffer, uint32_t bufferSize, int32_t value);
+uint32_t to_chars(char* buffer, uint32_t bufferSize, uint32_t value);
+uint32_t to_chars(char* buffer, uint32_t bufferSize, int64_t value);
+uint32_t to_chars(char* buffer, uint32_t bufferSize, uint64_t value);
+uint32_t to_chars(char* buffer, uint32_t bufferSize, float value);
+uint32_t to_chars(char* buffer, uint32_t bufferSize, double value);
+
+// Locale-independent number parsing. Returns a pointer past the last character consumed
+// or nullptr if [first, last) doesn't start with a number (or the integer doesn't fit
+// in the specified type). Only a leading '-' is accepted (no whitespace or '+').
+// Floating point results are correctly rounded. "inf", "infinity" and "nan" are recognized.
+const char* from_chars(const char* first, const char* last, int32_t& value);
+const char* from_chars(const char* first, const char* last, uint32_t& value);
+const char* from_chars(const char* first, const char* last, int64_t& value);
+const char* from_chars(const char* first, const char* last, uint64_t& value);
+const char* from_chars(const char* first, const char* last, float& value);
+const char* from_chars(const char* first, const char* last, double& value);
+
 class string
 {
 public:
@@ -40,6 +81,12 @@ public:
 	void append(const char* str);
 	void append(const char* first, const char* last);
 	void append(const string& str);
+	void append_number(int32_t value);
+	void append_number(uint32_t value);
+	void append_number(int64_t value);
+	void append_number(uint64_t value);
+	void append_number(float value);
+	void append_number(double value);
 
 	void resize(uint32_t sz);
 	void reserve(uint32_t capacity);
@@ -47,10 +94,17 @@ public:
 	void clear();
 
 	void tolower();
+	void toupper();
 	string substr(uint32_t first, uint32_t last) const;
 	uint32_t find_last_of(const char* charSet) const;
 
 private:
+	friend class string_builder;
+
+	template<typename T>
+	void append_number(T value, uint32_t maxChars);
+	void grow(uint32_t capacity);
+
 	char* m_String;
 	bx::AllocatorI* m_Allocator;
 	uint32_t m_Size;
@@ -151,7 +205,7 @@ inline void string::append(const char* str)
 inline void string::append(const char* first, const char* last)
 {
 	const uint32_t len = (uint32_t)(last - first);
-	reserve(m_Size + len + 1);
+	grow(m_Size + len + 1);
 	bx::memCopy(&m_String[m_Size], first, sizeof(char) * len);
 	m_Size += len;
 	m_String[m_Size] = char(0);
@@ -163,6 +217,44 @@ inline void string::append(const string& str)
 	append(cstr, cstr + str.size());
 }
 
+template<typename T>
+inline void string::append_number(T value, uint32_t maxChars)
+{
+	grow(m_Size + maxChars + 1);
+	m_Size += to_chars(&m_String[m_Size], maxChars, value);
+	m_String[m_Size] = char(0);
+}
+
+inline void string::append_number(int32_t value)
+{
+	append_number(value, kMaxCharsInt32);
+}
+
+inline void string::append_number(uint32_t value)
+{
+	append_number(value, kMaxCharsUInt32);
+}
+
+inline void string::append_number(int64_t value)
+{
+	append_number(value, kMaxCharsInt64);
+}
+
+inline void string::append_number(uint64_t value)
+{
+	append_number(value, kMaxCharsUInt64);
+}
+
+inline void string::append_number(float value)
+{
+	append_number(value, kMaxCharsFloat);
+}
+
+inline void string::append_number(double value)
+{
+	append_number(value, kMaxCharsDouble);
+}
+
 inline void string::assign(const char* str)
 {
 	const uint32_t len = bx::strLen(str);
@@ -190,6 +282,16 @@ inline void string::reserve(uint32_t newCapacity)
 	}
 }
 
+// Same as reserve() but grows the buffer geometrically, so appending one character
+// at a time doesn't reallocate every 16 characters.
+inline void string::grow(uint32_t newCapacity)
+{
+	if (newCapacity + 1 > m_Capacity) {
+		const uint32_t geometricCapacity = m_Capacity + (m_Capacity >> 1);
+		reserve(newCapacity > geometricCapacity ? newCapacity : geometricCapacity);
+	}
+}
+
 inline void string::clear()
 {
 	BX_FREE(m_Allocator, m_String);
@@ -207,7 +309,7 @@ inline void string::resize(uint32_t sz)
 
 inline void string::push_back(char ch)
 {
-	reserve(m_Size + 2);
+	grow(m_Size + 2);
 	m_String[m_Size++] = ch;
 	m_String[m_Size] = char(0);
 }
@@ -236,7 +338,7 @@ inline void string::insert(uint32_t pos, const char* str)
 		return;
 	}
 
-	reserve(m_Size + len + 1);
+	grow(m_Size + len + 1);
 	if (pos != m_Size - 1) {
 		bx::memMove(&m_String[pos + len], &m_String[pos], sizeof(char) * (m_Size - pos));
 	}
@@ -249,7 +351,10 @@ inline void string::sprintf(const char* fmt, ...)
 {
 	va_list args;
 	va_start(args, fmt);
-	int len = bx::vsnprintf(nullptr, 0, fmt, args);
+	va_list argsCopy;
+	va_copy(argsCopy, args);
+	int len = bx::vsnprintf(nullptr, 0, fmt, argsCopy);
+	va_end(argsCopy);
 	resize(len);
 	bx::vsnprintf(m_String, m_Size + 1, fmt, args);
 	va_end(args);
@@ -287,32 +392,97 @@ inline uint32_t string::find_last_of(const char* charSet) const
 
 inline void string::tolower()
 {
-	const uint32_t len = m_Size;
+	ascii_tolower(m_String, m_String, m_Size);
+}
 
-	const char* cstr = m_String;
-	for (uint32_t i = 0; i < len; ++i) {
-		m_String[i] = (char)::tolower(*cstr++);
-	}
+inline void string::toupper()
+{
+	ascii_toupper(m_String, m_String, m_Size);
+}
+
+inline bool operator == (const string& a, const string& b)
+{
+	return a.size() == b.size() && bx::memCmp(a.c_str(), b.c_str(), a.size()) == 0;
 }
 
+inline bool operator != (const string& a, const string& b)
+{
+	return !(a == b);
+}
+
+template<>
+struct hash<string>
+{
+	uint32_t operator() (const string& str) const
+	{
+		return fnv1a(str.c_str(), str.size());
+	}
+};
+
+// Case-insensitive functors. E.g. hash_map<string, T, getDefaultAllocator, string_hash_nocase, string_equal_nocase>
+struct string_hash_nocase
+{
+	uint32_t operator() (const string& str) const
+	{
+		return fnv1a_nocase(str.c_str(), str.size());
+	}
+};
+
+struct string_equal_nocase
+{
+	bool operator() (const string& a, const string& b) const
+	{
+		return equal_nocase(a.c_str(), a.size(), b.c_str(), b.size());
+	}
+};
+
+struct string_less_nocase
+{
+	bool operator() (const string& a, const string& b) const
+	{
+		return compare_nocase(a.c_str(), a.size(), b.c_str(), b.size()) < 0;
+	}
+};
+
 inline string to_string(int value)
 {
 	string str;
-	str.sprintf("%d", value);
+	str.append_number((int32_t)value);
 	return str;
 }
 
 inline string to_string(uint32_t value)
 {
 	string str;
-	str.sprintf("%u", value);
+	str.append_number(value);
+	return str;
+}
+
+inline string to_string(int64_t value)
+{
+	string str;
+	str.append_number(value);
+	return str;
+}
+
+inline string to_string(uint64_t value)
+{
+	string str;
+	str.append_number(value);
 	return str;
 }
 
 inline string to_string(float value)
 {
 	string str;
-	str.sprintf("%f", value);
+	str.append_number(value);
+	return str;
+}
+
+inline string to_string(double value)
+{
+	string str;
+	str.append_number(value);
 	return str;
 }
 }
@@ -0,0 +1,355 @@
+#ifndef JTL_STRING_BUILDER_H
+#define JTL_STRING_BUILDER_H
+
+#include <stdint.h>
+#include <stdarg.h>
+#include <bx/allocator.h>
+#include <bx/string.h>
+#include "jtl.h"
+#include "string.h"
+
+#include <utility> // std::move
+#include <type_traits> // std::enable_if, std::is_integral, std::type_identity, etc.
+
+namespace jtl
+{
+// Accumulates text into a single geometrically growing buffer. Every value is
+// formatted directly into the buffer's spare capacity and the final string is
+// handed off with release() without copying.
+//
+// append() and format() are type-safe: the formatting of each argument is picked
+// by overload resolution at compile time, and types without an overload (e.g.
+// pointers other than const char*) fail to compile.
+//
+// format() replaces each "{}" in fmt with the next argument ("{{" and "}}" produce
+// literal braces). With C++20 fmt must be a constant expression and the number of
+// placeholders is checked against the number of arguments at compile time; otherwise
+// it is only checked at runtime with JTL_CHECK.
+#if defined(__cpp_consteval)
+// Returns the number of "{}" placeholders in str, or -1 if it has unmatched braces.
+constexpr int32_t countFormatPlaceholders(const char* str)
+{
+	int32_t count = 0;
+	while (*str) {
+		const char ch = *str++;
+		if (ch == '{' && *str == '}') {
+			++count;
+			++str;
+		} else if (ch == '{' || ch == '}') {
+			if (*str != ch) {
+				return -1;
+			}
+			++str;
+		}
+	}
+	return count;
+}
+
+// Not constexpr: calling it from the consteval constructor is a compile error.
+void formatStringMismatch();
+
+template<typename... Args>
+class format_string
+{
+public:
+	template<typename T, typename = typename std::enable_if<std::is_convertible<const T&, const char*>::value>::type>
+	consteval format_string(const T& str)
+		: m_String(str)
+	{
+		if (countFormatPlaceholders(m_String) != (int32_t)sizeof...(Args)) {
+			formatStringMismatch();
+		}
+	}
+
+	const char* get() const
+	{
+		return m_String;
+	}
+
+private:
+	const char* m_String;
+};
+#endif
+
+class string_builder
+{
+public:
+	string_builder(bx::AllocatorI* allocator = nullptr);
+	explicit string_builder(uint32_t capacity, bx::AllocatorI* allocator = nullptr);
+	~string_builder();
+
+	const char* c_str() const;
+	uint32_t size() const;
+	bool empty() const;
+	const string& str() const;
+
+	template<typename... Args>
+	string_builder& append(const Args&... args);
+
+#if defined(__cpp_consteval)
+	template<typename... Args>
+	string_builder& format(format_string<std::type_identity_t<Args>...> fmt, const Args&... args);
+#else
+	template<typename... Args>
+	string_builder& format(const char* fmt, const Args&... args);
+#endif
+
+	string_builder& appendf(const char* fmt, ...);
+	string_builder& vappendf(const char* fmt, va_list args);
+
+	void reserve(uint32_t capacity);
+	void clear();
+
+	string release();
+
+private:
+	string m_String;
+
+	void appendValue(const char* str);
+	void appendValue(const string& str);
+	void appendValue(const bx::StringView& str);
+	void appendValue(char ch);
+	void appendValue(bool value);
+	void appendValue(float value);
+	void appendValue(double value);
+
+	// Would otherwise convert to bool.
+	template<typename T>
+	void appendValue(const T* ptr) = delete;
+
+	template<typename T>
+	typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type appendValue(T value);
+
+	template<typename T>
+	typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type appendValue(T value);
+
+	const char* appendLiteral(const char* fmt);
+	void formatImpl(const char* fmt);
+
+	template<typename T, typename... Args>
+	void formatImpl(const char* fmt, const T& first, const Args&... rest);
+};
+
+inline string_builder::string_builder(bx::AllocatorI* allocator)
+	: m_String(allocator)
+{
+}
+
+inline string_builder::string_builder(uint32_t capacity, bx::AllocatorI* allocator)
+	: m_String(allocator)
+{
+	m_String.reserve(capacity);
+}
+
+inline string_builder::~string_builder()
+{
+}
+
+inline const char* string_builder::c_str() const
+{
+	return m_String.c_str();
+}
+
+inline uint32_t string_builder::size() const
+{
+	return m_String.size();
+}
+
+inline bool string_builder::empty() const
+{
+	return m_String.empty();
+}
+
+inline const string& string_builder::str() const
+{
+	return m_String;
+}
+
+template<typename... Args>
+inline string_builder& string_builder::append(const Args&... args)
+{
+	// Expand the pack in order (C++11 doesn't have fold expressions).
+	int dummy[] = { 0, (appendValue(args), 0)... };
+	BX_UNUSED(dummy);
+	return *this;
+}
+
+#if defined(__cpp_consteval)
+template<typename... Args>
+inline string_builder& string_builder::format(format_string<std::type_identity_t<Args>...> fmt, const Args&... args)
+{
+	formatImpl(fmt.get(), args...);
+	return *this;
+}
+#else
+template<typename... Args>
+inline string_builder& string_builder::format(const char* fmt, const Args&... args)
+{
+	formatImpl(fmt, args...);
+	return *this;
+}
+#endif
+
+inline string_builder& string_builder::appendf(const char* fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	vappendf(fmt, args);
+	va_end(args);
+	return *this;
+}
+
+inline string_builder& string_builder::vappendf(const char* fmt, va_list args)
+{
+	// Try to format into the spare capacity first and only format a second time
+	// if it didn't fit.
+	const uint32_t size = m_String.m_Size;
+	m_String.grow(size + 64);
+	const uint32_t available = m_String.m_Capacity - size;
+
+	va_list argsCopy;
+	va_copy(argsCopy, args);
+	const int32_t len = bx::vsnprintf(&m_String.m_String[size], available, fmt, argsCopy);
+	va_end(argsCopy);
+
+	if (len < 0) {
+		m_String.m_String[size] = char(0);
+		return *this;
+	}
+
+	if ((uint32_t)len >= available) {
+		m_String.grow(size + len + 1);
+		bx::vsnprintf(&m_String.m_String[size], len + 1, fmt, args);
+	}
+	m_String.m_Size = size + len;
+
+	return *this;
+}
+
+inline void string_builder::reserve(uint32_t capacity)
+{
+	m_String.reserve(capacity);
+}
+
+inline void string_builder::clear()
+{
+	// Keep the buffer around for reuse.
+	m_String.resize(0);
+}
+
+inline string string_builder::release()
+{
+	return string(std::move(m_String));
+}
+
+inline void string_builder::appendValue(const char* str)
+{
+	m_String.append(str);
+}
+
+inline void string_builder::appendValue(const string& str)
+{
+	m_String.append(str);
+}
+
+inline void string_builder::appendValue(const bx::StringView& str)
+{
+	m_String.append(str.getPtr(), str.getTerm());
+}
+
+inline void string_builder::appendValue(char ch)
+{
+	m_String.push_back(ch);
+}
+
+inline void string_builder::appendValue(bool value)
+{
+	if (value) {
+		m_String.append("true", "true" + 4);
+	} else {
+		m_String.append("false", "false" + 5);
+	}
+}
+
+inline void string_builder::appendValue(float value)
+{
+	m_String.append_number(value);
+}
+
+inline void string_builder::appendValue(double value)
+{
+	m_String.append_number(value);
+}
+
+template<typename T>
+inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type string_builder::appendValue(T value)
+{
+	if (sizeof(T) <= sizeof(int32_t)) {
+		m_String.append_number((int32_t)value);
+	} else {
+		m_String.append_number((int64_t)value);
+	}
+}
+
+template<typename T>
+inline typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type string_builder::appendValue(T value)
+{
+	if (sizeof(T) <= sizeof(uint32_t)) {
+		m_String.append_number((uint32_t)value);
+	} else {
+		m_String.append_number((uint64_t)value);
+	}
+}
+
+// Appends fmt up to the next "{}" (unescaping "{{" and "}}") and returns a pointer
+// to the placeholder, or to the null terminator if there isn't one.
+inline const char* string_builder::appendLiteral(const char* fmt)
+{
+	const char* start = fmt;
+	for (;;) {
+		const char ch = *fmt;
+		if (ch == '\0') {
+			break;
+		}
+
+		if (ch == '{' || ch == '}') {
+			if (ch == '{' && fmt[1] == '}') {
+				break;
+			}
+
+			JTL_CHECK(fmt[1] == ch, "Unmatched '%c' in format string", ch);
+			m_String.append(start, fmt + 1);
+			fmt += fmt[1] == ch ? 2 : 1;
+			start = fmt;
+			continue;
+		}
+
+		++fmt;
+	}
+
+	m_String.append(start, fmt);
+	return fmt;
+}
+
+inline void string_builder::formatImpl(const char* fmt)
+{
+	const char* ptr = appendLiteral(fmt);
+	JTL_CHECK(*ptr == '\0', "Not enough arguments for format string");
+	BX_UNUSED(ptr);
+}
+
+template<typename T, typename... Args>
+inline void string_builder::formatImpl(const char* fmt, const T& first, const Args&... rest)
+{
+	const char* ptr = appendLiteral(fmt);
+	JTL_CHECK(*ptr != '\0', "Too many arguments for format string");
+	if (*ptr == '\0') {
+		return;
+	}
+
+	appendValue(first);
+	formatImpl(ptr + 2, rest...);
+}
+}
+
+#endif
@@ -0,0 +1,323 @@
+#ifndef JTL_STRING_POOL_H
+#define JTL_STRING_POOL_H
+
+#include <stdint.h>
+#include <bx/allocator.h>
+#include <bx/string.h>
+#include "jtl.h"
+#include "string.h"
+
+namespace jtl
+{
+class string_pool;
+
+// Handle to a string interned in a string_pool. Two atoms from the same pool are equal
+// iff they refer to the same text, so comparison is a single pointer compare, and the
+// hash is computed once at intern time. Atoms stay valid until the pool is cleared or
+// destroyed.
+class atom
+{
+public:
+	atom();
+
+	const char* c_str() const;
+	uint32_t size() const;
+	uint32_t hash() const;
+	bool empty() const;
+	bx::StringView view() const;
+
+	bool operator == (const atom& other) const;
+	bool operator != (const atom& other) const;
+	operator bool() const;
+
+private:
+	friend class string_pool;
+
+	struct Entry
+	{
+		uint32_t m_Hash;
+		uint32_t m_Length;
+		// Followed by m_Length + 1 chars (null terminated)
+
+		const char* getString() const
+		{
+			return (const char*)(this + 1);
+		}
+	};
+
+	explicit atom(const Entry* entry);
+
+	const Entry* m_Entry;
+};
+
+template<>
+struct hash<atom>
+{
+	uint32_t operator() (const atom& a) const
+	{
+		return a.hash();
+	}
+};
+
+// Deduplicating string storage. Strings are copied into large arena pages allocated
+// from the specified allocator and are only freed all together by clear() or the
+// destructor. Not thread-safe.
+class string_pool
+{
+public:
+	string_pool(bx::AllocatorI* allocator = nullptr, uint32_t pageSize = 64 * 1024);
+	~string_pool();
+
+	atom intern(const char* str);
+	atom intern(const char* str, uint32_t len);
+	atom intern(const string& str);
+	atom intern(const bx::StringView& str);
+
+	// Returns a null atom if str hasn't been interned.
+	atom find(const char* str, uint32_t len) const;
+
+	uint32_t size() const;
+	void clear();
+
+private:
+	typedef atom::Entry Entry;
+
+	struct Page
+	{
+		Page* m_Next;
+		uint32_t m_Size;
+		uint32_t m_Capacity;
+	};
+
+	struct Slot
+	{
+		uint32_t m_Hash;
+		const Entry* m_Entry;
+	};
+
+	bx::AllocatorI* m_Allocator;
+	Page* m_Pages;
+	Slot* m_Slots;
+	uint32_t m_NumSlots;
+	uint32_t m_NumEntries;
+	uint32_t m_PageSize;
+
+	uint32_t findSlot(const char* str, uint32_t len, uint32_t hash) const;
+	Entry* allocEntry(const char* str, uint32_t len, uint32_t hash);
+	void rehash(uint32_t numSlots);
+
+	string_pool(const string_pool&) = delete;
+	string_pool& operator = (const string_pool&) = delete;
+};
+
+inline atom::atom()
+	: m_Entry(nullptr)
+{
+}
+
+inline atom::atom(const Entry* entry)
+	: m_Entry(entry)
+{
+}
+
+inline const char* atom::c_str() const
+{
+	return m_Entry ? m_Entry->getString() : "";
+}
+
+inline uint32_t atom::size() const
+{
+	return m_Entry ? m_Entry->m_Length : 0;
+}
+
+inline uint32_t atom::hash() const
+{
+	return m_Entry ? m_Entry->m_Hash : 0;
+}
+
+inline bool atom::empty() const
+{
+	return size() == 0;
+}
+
+inline bx::StringView atom::view() const
+{
+	return bx::StringView(c_str(), (int32_t)size());
+}
+
+inline bool atom::operator == (const atom& other) const
+{
+	return m_Entry == other.m_Entry;
+}
+
+inline bool atom::operator != (const atom& other) const
+{
+	return m_Entry != other.m_Entry;
+}
+
+inline atom::operator bool() const
+{
+	return m_Entry != nullptr;
+}
+
+inline string_pool::string_pool(bx::AllocatorI* allocator, uint32_t pageSize)
+	: m_Allocator(allocator ? allocator : getDefaultAllocator())
+	, m_Pages(nullptr)
+	, m_Slots(nullptr)
+	, m_NumSlots(0)
+	, m_NumEntries(0)
+	, m_PageSize(pageSize)
+{
+}
+
+inline string_pool::~string_pool()
+{
+	clear();
+}
+
+inline atom string_pool::intern(const char* str)
+{
+	return intern(str, bx::strLen(str));
+}
+
+inline atom string_pool::intern(const string& str)
+{
+	return intern(str.c_str(), str.size());
+}
+
+inline atom string_pool::intern(const bx::StringView& str)
+{
+	return intern(str.getPtr(), (uint32_t)str.getLength());
+}
+
+inline atom string_pool::intern(const char* str, uint32_t len)
+{
+	const uint32_t hash = fnv1a(str, len);
+
+	// Keep the load factor <= 0.5
+	if ((m_NumEntries + 1) * 2 > m_NumSlots) {
+		rehash(m_NumSlots ? m_NumSlots * 2 : 64);
+	}
+
+	const uint32_t slotID = findSlot(str, len, hash);
+	Slot* slot = &m_Slots[slotID];
+	if (!slot->m_Entry) {
+		slot->m_Hash = hash;
+		slot->m_Entry = allocEntry(str, len, hash);
+		++m_NumEntries;
+	}
+
+	return atom(slot->m_Entry);
+}
+
+inline atom string_pool::find(const char* str, uint32_t len) const
+{
+	if (!m_NumEntries) {
+		return atom();
+	}
+
+	return atom(m_Slots[findSlot(str, len, fnv1a(str, len))].m_Entry);
+}
+
+inline uint32_t string_pool::size() const
+{
+	return m_NumEntries;
+}
+
+inline void string_pool::clear()
+{
+	Page* page = m_Pages;
+	while (page) {
+		Page* next = page->m_Next;
+		BX_FREE(m_Allocator, page);
+		page = next;
+	}
+
+	BX_FREE(m_Allocator, m_Slots);
+	m_Pages = nullptr;
+	m_Slots = nullptr;
+	m_NumSlots = 0;
+	m_NumEntries = 0;
+}
+
+// Returns the slot holding str or the empty slot where it should be inserted.
+inline uint32_t string_pool::findSlot(const char* str, uint32_t len, uint32_t hash) const
+{
+	const uint32_t mask = m_NumSlots - 1;
+	for (uint32_t slotID = hash & mask;; slotID = (slotID + 1) & mask) {
+		const Slot* slot = &m_Slots[slotID];
+		if (!slot->m_Entry) {
+			return slotID;
+		}
+
+		const Entry* entry = slot->m_Entry;
+		if (slot->m_Hash == hash && entry->m_Length == len && bx::memCmp(entry->getString(), str, len) == 0) {
+			return slotID;
+		}
+	}
+}
+
+inline string_pool::Entry* string_pool::allocEntry(const char* str, uint32_t len, uint32_t hash)
+{
+	// Keep entries 4-byte aligned.
+	const uint32_t entrySize = ((uint32_t)sizeof(Entry) + len + 1 + 3) & ~3u;
+
+	Page* page = m_Pages;
+	if (!page || page->m_Size + entrySize > page->m_Capacity) {
+		// Strings which don't fit comfortably in a page get a page of their own. It's linked
+		// after the current page so the remaining space of the latter can still be used.
+		const bool dedicated = entrySize > m_PageSize / 4;
+		const uint32_t capacity = dedicated ? entrySize : m_PageSize;
+		Page* newPage = (Page*)BX_ALLOC(m_Allocator, sizeof(Page) + capacity);
+		JTL_CHECK(newPage, "Allocation failed");
+		newPage->m_Size = 0;
+		newPage->m_Capacity = capacity;
+
+		if (dedicated && page) {
+			newPage->m_Next = page->m_Next;
+			page->m_Next = newPage;
+		} else {
+			newPage->m_Next = m_Pages;
+			m_Pages = newPage;
+		}
+		page = newPage;
+	}
+
+	Entry* entry = (Entry*)((uint8_t*)(page + 1) + page->m_Size);
+	page->m_Size += entrySize;
+
+	entry->m_Hash = hash;
+	entry->m_Length = len;
+	char* dst = (char*)(entry + 1);
+	bx::memCopy(dst, str, len);
+	dst[len] = char(0);
+
+	return entry;
+}
+
+inline void string_pool::rehash(uint32_t numSlots)
+{
+	Slot* newSlots = (Slot*)BX_ALLOC(m_Allocator, sizeof(Slot) * numSlots);
+	JTL_CHECK(newSlots, "Allocation failed");
+	bx::memSet(newSlots, 0, sizeof(Slot) * numSlots);
+
+	const uint32_t mask = numSlots - 1;
+	const uint32_t oldNumSlots = m_NumSlots;
+	for (uint32_t i = 0; i < oldNumSlots; ++i) {
+		const Slot& oldSlot = m_Slots[i];
+		if (oldSlot.m_Entry) {
+			uint32_t slotID = oldSlot.m_Hash & mask;
+			while (newSlots[slotID].m_Entry) {
+				slotID = (slotID + 1) & mask;
+			}
+			newSlots[slotID] = oldSlot;
+		}
+	}
+
+	BX_FREE(m_Allocator, m_Slots);
+	m_Slots = newSlots;
+	m_NumSlots = numSlots;
+}
+}
+
+#endif
@@ -0,0 +1,436 @@
+#ifndef JTL_TASK_H
+#define JTL_TASK_H
+
+#include <stdint.h>
+#include <bx/allocator.h>
+#include "jtl.h"
+#include "scheduler.h"
+#include "future.h"
+#include "pool_allocator.h"
+
+#if defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <exception> // std::terminate
+#include <utility> // std::forward, std::move
+#include <type_traits> // std::aligned_storage, std::is_void
+
+namespace jtl
+{
+template<typename T>
+class task;
+
+// Resumes the awaiting coroutine (if any) when a task completes. Returning the handle
+// from await_suspend() transfers control directly to it, so long chains of tasks
+// completing synchronously don't grow the stack.
+template<typename Promise>
+struct TaskFinalAwaiter
+{
+	bool await_ready() const noexcept
+	{
+		return false;
+	}
+
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+	{
+		std::coroutine_handle<> continuation = handle.promise().m_Continuation;
+		return continuation ? continuation : std::noop_coroutine();
+	}
+
+	void await_resume() noexcept
+	{
+	}
+};
+
+// Coroutine frames are allocated from the pool allocator.
+struct TaskPromiseBase
+{
+	std::coroutine_handle<> m_Continuation;
+
+	static void* operator new(size_t size)
+	{
+		void* mem = BX_ALLOC(getPoolAllocator(), size);
+		JTL_CHECK(mem, "Allocation failed");
+		return mem;
+	}
+
+	static void operator delete(void* ptr)
+	{
+		BX_FREE(getPoolAllocator(), ptr);
+	}
+
+	std::suspend_always initial_suspend() noexcept
+	{
+		return std::suspend_always();
+	}
+
+	void unhandled_exception()
+	{
+		JTL_CHECK(false, "Unhandled exception in coroutine");
+		std::terminate();
+	}
+};
+
+template<typename T>
+struct TaskPromise : public TaskPromiseBase
+{
+	typename std::aligned_storage<sizeof(T), alignof(T)>::type m_Value;
+	bool m_HasValue = false;
+
+	~TaskPromise()
+	{
+		if (m_HasValue) {
+			getValue()->~T();
+		}
+	}
+
+	task<T> get_return_object() noexcept;
+
+	TaskFinalAwaiter<TaskPromise> final_suspend() noexcept
+	{
+		return TaskFinalAwaiter<TaskPromise>();
+	}
+
+	template<typename U>
+	void return_value(U&& value)
+	{
+		BX_PLACEMENT_NEW(getValue(), T)(std::forward<U>(value));
+		m_HasValue = true;
+	}
+
+	T* getValue()
+	{
+		return (T*)&m_Value;
+	}
+
+	T take()
+	{
+		JTL_CHECK(m_HasValue, "Task hasn't completed");
+		return std::move(*getValue());
+	}
+};
+
+template<>
+struct TaskPromise<void> : public TaskPromiseBase
+{
+	task<void> get_return_object() noexcept;
+
+	TaskFinalAwaiter<TaskPromise> final_suspend() noexcept
+	{
+		return TaskFinalAwaiter<TaskPromise>();
+	}
+
+	void return_void()
+	{
+	}
+
+	void take()
+	{
+	}
+};
+
+// Lazily started coroutine producing a T. The coroutine starts running when the task is
+// awaited, on the awaiting thread, and the awaiting coroutine is resumed when it
+// completes. Use schedule_on() to move a coroutine to a scheduler, and sync_wait() to
+// run a task from regular code.
+//
+// Exceptions aren't supported; an exception escaping a coroutine terminates the
+// program.
+template<typename T = void>
+class task
+{
+public:
+	typedef TaskPromise<T> promise_type;
+
+	task();
+	task(task&& other);
+	~task();
+
+	task& operator = (task&& other);
+
+	bool valid() const;
+	bool is_ready() const;
+
+	auto operator co_await() && noexcept;
+	auto operator co_await() & noexcept;
+
+private:
+	friend struct TaskPromise<T>;
+
+	std::coroutine_handle<promise_type> m_Handle;
+
+	explicit task(std::coroutine_handle<promise_type> handle);
+
+	task(const task&) = delete;
+	task& operator = (const task&) = delete;
+};
+
+template<typename T>
+struct TaskAwaiter
+{
+	std::coroutine_handle<TaskPromise<T> > m_Handle;
+
+	bool await_ready() const noexcept
+	{
+		return !m_Handle || m_Handle.done();
+	}
+
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+	{
+		m_Handle.promise().m_Continuation = awaiting;
+		return m_Handle;
+	}
+
+	T await_resume()
+	{
+		JTL_CHECK(m_Handle, "Awaiting an invalid task");
+		return m_Handle.promise().take();
+	}
+};
+
+// Suspends the awaiting coroutine until the future is ready instead of blocking the
+// thread. The coroutine is resumed on sched (the current worker's scheduler or the
+// default one if nullptr).
+template<typename T>
+struct FutureAwaiter : public scheduler_task
+{
+	future<T>& m_Future;
+	scheduler* m_Scheduler;
+	std::coroutine_handle<> m_Handle;
+
+	FutureAwaiter(future<T>& f, scheduler* sched)
+		: m_Future(f)
+		, m_Scheduler(sched)
+	{
+		m_Next = nullptr;
+		m_Execute = execute;
+	}
+
+	bool await_ready() const noexcept
+	{
+		return m_Future.is_ready();
+	}
+
+	void await_suspend(std::coroutine_handle<> handle) noexcept
+	{
+		JTL_CHECK(m_Future.valid(), "Awaiting an invalid future");
+		m_Handle = handle;
+
+		scheduler* sched = m_Scheduler;
+		if (!sched) {
+			sched = getCurrentScheduler();
+			sched = sched ? sched : getDefaultScheduler();
+		}
+
+		futureAttach(m_Future.m_State, this, sched);
+	}
+
+	T await_resume()
+	{
+		return m_Future.get();
+	}
+
+	static void execute(scheduler_task* task)
+	{
+		static_cast<FutureAwaiter*>(task)->m_Handle.resume();
+	}
+};
+
+template<typename T>
+inline FutureAwaiter<T> operator co_await(future<T>& f) noexcept
+{
+	return FutureAwaiter<T>(f, nullptr);
+}
+
+template<typename T>
+inline FutureAwaiter<T> operator co_await(future<T>&& f) noexcept
+{
+	return FutureAwaiter<T>(f, nullptr);
+}
+
+// co_await schedule_on(sched) resumes the coroutine on one of sched's workers.
+struct ScheduleAwaiter : public scheduler_task
+{
+	scheduler* m_Scheduler;
+	std::coroutine_handle<> m_Handle;
+
+	explicit ScheduleAwaiter(scheduler* sched)
+		: m_Scheduler(sched ? sched : getDefaultScheduler())
+	{
+		m_Next = nullptr;
+		m_Execute = execute;
+	}
+
+	bool await_ready() const noexcept
+	{
+		return false;
+	}
+
+	void await_suspend(std::coroutine_handle<> handle) noexcept
+	{
+		m_Handle = handle;
+		m_Scheduler->submit(this);
+	}
+
+	void await_resume() noexcept
+	{
+	}
+
+	static void execute(scheduler_task* task)
+	{
+		static_cast<ScheduleAwaiter*>(task)->m_Handle.resume();
+	}
+};
+
+inline ScheduleAwaiter schedule_on(scheduler* sched = nullptr)
+{
+	return ScheduleAwaiter(sched);
+}
+
+// Eagerly started coroutine which destroys itself when done. Used by sync_wait().
+struct DetachedCoroutine
+{
+	struct promise_type
+	{
+		static void* operator new(size_t size)
+		{
+			void* mem = BX_ALLOC(getPoolAllocator(), size);
+			JTL_CHECK(mem, "Allocation failed");
+			return mem;
+		}
+
+		static void operator delete(void* ptr)
+		{
+			BX_FREE(getPoolAllocator(), ptr);
+		}
+
+		DetachedCoroutine get_return_object() noexcept
+		{
+			return DetachedCoroutine();
+		}
+
+		std::suspend_never initial_suspend() noexcept
+		{
+			return std::suspend_never();
+		}
+
+		std::suspend_never final_suspend() noexcept
+		{
+			return std::suspend_never();
+		}
+
+		void return_void()
+		{
+		}
+
+		void unhandled_exception()
+		{
+			JTL_CHECK(false, "Unhandled exception in coroutine");
+			std::terminate();
+		}
+	};
+};
+
+template<typename T>
+inline DetachedCoroutine syncWaitCoroutine(task<T> t, promise<T> p)
+{
+	if constexpr (std::is_void<T>::value) {
+		co_await std::move(t);
+		p.set_value();
+	} else {
+		p.set_value(co_await std::move(t));
+	}
+}
+
+// Runs the task to completion and returns its result. The task starts on the calling
+// thread; worker threads keep running other tasks while waiting, other threads block.
+template<typename T>
+inline T sync_wait(task<T>&& t)
+{
+	promise<T> p;
+	future<T> f = p.get_future();
+	syncWaitCoroutine(std::move(t), std::move(p));
+	return f.get();
+}
+
+template<typename T>
+inline task<T> TaskPromise<T>::get_return_object() noexcept
+{
+	return task<T>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+}
+
+inline task<void> TaskPromise<void>::get_return_object() noexcept
+{
+	return task<void>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+}
+
+template<typename T>
+inline task<T>::task()
+	: m_Handle(nullptr)
+{
+}
+
+template<typename T>
+inline task<T>::task(std::coroutine_handle<promise_type> handle)
+	: m_Handle(handle)
+{
+}
+
+template<typename T>
+inline task<T>::task(task&& other)
+	: m_Handle(other.m_Handle)
+{
+	other.m_Handle = nullptr;
+}
+
+template<typename T>
+inline task<T>::~task()
+{
+	if (m_Handle) {
+		m_Handle.destroy();
+	}
+}
+
+template<typename T>
+inline task<T>& task<T>::operator = (task&& other)
+{
+	if (&other != this) {
+		if (m_Handle) {
+			m_Handle.destroy();
+		}
+
+		m_Handle = other.m_Handle;
+		other.m_Handle = nullptr;
+	}
+
+	return *this;
+}
+
+template<typename T>
+inline bool task<T>::valid() const
+{
+	return (bool)m_Handle;
+}
+
+template<typename T>
+inline bool task<T>::is_ready() const
+{
+	return m_Handle && m_Handle.done();
+}
+
+template<typename T>
+inline auto task<T>::operator co_await() && noexcept
+{
+	return TaskAwaiter<T>{ m_Handle };
+}
+
+template<typename T>
+inline auto task<T>::operator co_await() & noexcept
+{
+	return TaskAwaiter<T>{ m_Handle };
+}
+}
+
+#endif // defined(__cpp_impl_coroutine)
+
+#endif
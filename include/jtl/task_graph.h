@@ -0,0 +1,130 @@
+#ifndef JTL_TASK_GRAPH_H
+#define JTL_TASK_GRAPH_H
+
+#include <stdint.h>
+#include <bx/allocator.h>
+#include "jtl.h"
+#include "scheduler.h"
+#include "inplace_function.h"
+#include "vector.h"
+
+#include <utility> // std::forward
+#include <type_traits> // std::remove_reference
+
+namespace jtl
+{
+struct TaskGraphNode;
+struct TaskGraphSignal;
+
+// Directed acyclic graph of tasks which is built once and run any number of times (e.g.
+// once per frame) on a scheduler. Tasks whose dependencies have all completed are
+// submitted to the scheduler as they become ready, so independent branches run in
+// parallel and are load balanced by work stealing.
+//
+// Nodes are intrusive scheduler tasks and the dependency counts are reset in place, so
+// running the graph doesn't allocate. Changing the graph is only allowed while it isn't
+// running.
+class task_graph
+{
+public:
+	typedef uint32_t task_id;
+	typedef inplace_function<void(), 48> function_type;
+
+	task_graph(scheduler* sched = nullptr, bx::AllocatorI* allocator = nullptr);
+	~task_graph();
+
+	void reserve(uint32_t numTasks);
+
+	task_id add(function_type&& func);
+
+	// task won't start before dependency has completed.
+	void depend(task_id task, task_id dependency);
+
+	void clear();
+	uint32_t size() const;
+
+	// Starts running the graph and returns immediately. Returns false (and doesn't run
+	// anything) if the dependencies form a cycle.
+	bool start();
+
+	// Waits for the run started by start() to complete. Worker threads run other tasks in
+	// the meantime.
+	void wait();
+
+	// True once the last run has completed, i.e. when wait() wouldn't block.
+	bool is_done() const;
+
+	// start() + wait()
+	bool run();
+
+private:
+	scheduler* m_Scheduler;
+	bx::AllocatorI* m_Allocator;
+	TaskGraphNode* m_Nodes;
+	TaskGraphSignal* m_Signal;
+	vector<uint64_t> m_Edges; // (dependency << 32) | task, sorted by build()
+	uint32_t* m_Successors;
+	uint32_t m_NumNodes;
+	uint32_t m_Capacity;
+	uint32_t m_NumSuccessors;
+	int32_t m_Remaining;
+	bool m_Dirty;
+
+	bool build();
+	bool isAcyclic();
+
+	static void executeNode(scheduler_task* task);
+
+	task_graph(const task_graph&) = delete;
+	task_graph& operator = (const task_graph&) = delete;
+};
+
+// Calls func(first, last) for consecutive subranges of [begin, end) in parallel. The
+// range is split into chunks of at least grainSize indices (0 picks a size which gives
+// every worker a few chunks to balance the load). The calling thread runs chunks too
+// and returns once all of them have completed.
+void parallelForRange(uint32_t begin, uint32_t end, uint32_t grainSize, void (*func)(void* userData, uint32_t first, uint32_t last), void* userData, scheduler* sched = nullptr);
+
+// Calls func(i) for every i in [begin, end) in parallel.
+template<typename FUNC>
+void parallel_for(uint32_t begin, uint32_t end, FUNC&& func, uint32_t grainSize = 0, scheduler* sched = nullptr);
+
+// Calls func(item) for every item of the vector in parallel.
+template<typename T, GetAllocatorFunc A, typename FUNC>
+void parallel_for(vector<T, A>& items, FUNC&& func, uint32_t grainSize = 0, scheduler* sched = nullptr);
+
+template<typename FUNC>
+inline void parallel_for(uint32_t begin, uint32_t end, FUNC&& func, uint32_t grainSize, scheduler* sched)
+{
+	typedef typename std::remove_reference<FUNC>::type FuncT;
+
+	struct Range
+	{
+		static void call(void* userData, uint32_t first, uint32_t last)
+		{
+			FuncT& f = *(FuncT*)userData;
+			for (uint32_t i = first; i < last; ++i) {
+				f(i);
+			}
+		}
+	};
+
+	parallelForRange(begin, end, grainSize, Range::call, (void*)&func, sched);
+}
+
+template<typename T, GetAllocatorFunc A, typename FUNC>
+inline void parallel_for(vector<T, A>& items, FUNC&& func, uint32_t grainSize, scheduler* sched)
+{
+	T* data = items.begin();
+	parallel_for(0, items.size(), [data, &func](uint32_t i) {
+		func(data[i]);
+	}, grainSize, sched);
+}
+
+inline uint32_t task_graph::size() const
+{
+	return m_NumNodes;
+}
+}
+
+#endif
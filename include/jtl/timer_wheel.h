@@ -0,0 +1,102 @@
+#ifndef JTL_TIMER_WHEEL_H
+#define JTL_TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <bx/allocator.h>
+#include "jtl.h"
+#include "inplace_function.h"
+
+#include <mutex>
+
+namespace jtl
+{
+struct TimerNode;
+struct TimerDriver;
+
+// Identifies a scheduled timer. Default constructed handles are invalid.
+struct timer_handle
+{
+	uint32_t m_Index;
+	uint32_t m_Generation;
+
+	timer_handle()
+		: m_Index(0)
+		, m_Generation(0)
+	{
+	}
+
+	bool isValid() const
+	{
+		return m_Generation != 0;
+	}
+};
+
+// Hierarchical timer wheel with kNumLevels levels of kNumSlots slots each. Level L
+// holds the timers which expire within kNumSlots^(L+1) ticks; when the lower levels
+// wrap around, the timers of the next slot of level L are redistributed to the lower
+// levels, and level 0 timers fire when the wheel reaches their slot. Scheduling and
+// canceling are O(1) (cancel goes through the handle: index + generation), and every
+// timer is moved at most kNumLevels - 1 times before firing. Delays longer than
+// kNumSlots^kNumLevels ticks are supported by parking the timer in the last level.
+//
+// Time is measured in ticks. The wheel is advanced either manually with advance() or
+// by a background thread started with start(), which advances it by one tick every
+// tickMs milliseconds. Callbacks run on the thread advancing the wheel, without any
+// lock held, so they can schedule and cancel timers themselves. All the other methods
+// are thread safe.
+class timer_wheel
+{
+public:
+	typedef inplace_function<void(), 48> callback_type;
+
+	static const uint32_t kNumLevels = 4;
+	static const uint32_t kNumSlots = 256;
+
+	timer_wheel(bx::AllocatorI* allocator = nullptr);
+	~timer_wheel();
+
+	// Calls callback once delayTicks ticks have elapsed (at least 1).
+	timer_handle schedule(uint64_t delayTicks, callback_type&& callback);
+
+	// Returns false if the timer has already fired or been canceled.
+	bool cancel(timer_handle handle);
+
+	// Advances the wheel by numTicks ticks and runs the expired callbacks. Returns the
+	// number of callbacks which have been run.
+	uint32_t advance(uint32_t numTicks = 1);
+
+	void start(uint32_t tickMs = 1);
+	void stop();
+
+	uint64_t now() const;
+	uint32_t size() const;
+
+private:
+	static const uint32_t kSlotBits = 8;
+	static const uint32_t kFiringList = kNumLevels * kNumSlots;
+
+	mutable std::mutex m_Mutex;
+	bx::AllocatorI* m_Allocator;
+	TimerNode* m_Nodes;
+	TimerDriver* m_Driver;
+	uint32_t m_Slots[kNumLevels * kNumSlots + 1]; // List heads, the last one is the firing list
+	uint64_t m_Now;
+	uint32_t m_NumNodes;
+	uint32_t m_Capacity;
+	uint32_t m_FreeList;
+	uint32_t m_NumTimers;
+
+	uint32_t allocNode();
+	void freeNode(uint32_t index);
+	void link(uint32_t index, uint32_t list);
+	void unlink(uint32_t index);
+	void insert(uint32_t index);
+	void cascade(uint32_t level);
+	uint32_t fireExpired();
+
+	timer_wheel(const timer_wheel&) = delete;
+	timer_wheel& operator = (const timer_wheel&) = delete;
+};
+}
+
+#endif
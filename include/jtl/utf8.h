@@ -0,0 +1,225 @@
+#ifndef JTL_UTF8_H
+#define JTL_UTF8_H
+
+#include <stdint.h>
+#include "jtl.h"
+#include "string.h"
+#include "vector.h"
+
+namespace jtl
+{
+static const uint32_t kUnicodeReplacementChar = 0xFFFD;
+static const uint32_t kInvalidUTF = ~0u;
+
+// Returns true if [str, str + len) is well-formed UTF-8, i.e. no overlong encodings,
+// surrogates, code points above U+10FFFF or truncated sequences. Uses SIMD (SSSE3/AVX2)
+// when available, with a fast path for pure ASCII blocks.
+bool utf8_validate(const char* str, uint32_t len);
+
+// Number of code points in a valid UTF-8 string.
+uint32_t utf8_length(const char* str, uint32_t len);
+
+// Decodes the code point starting at str. Returns the number of bytes consumed, or 0 if
+// the sequence is invalid (in which case codepoint is set to kUnicodeReplacementChar).
+uint32_t utf8_decode(const char* str, uint32_t len, uint32_t& codepoint);
+
+// Writes the UTF-8 encoding of codepoint (1 to 4 bytes) to dst. Returns the number of
+// bytes written, or 0 for surrogates and values above U+10FFFF.
+uint32_t utf8_encode(char* dst, uint32_t codepoint);
+
+// Transcoding into raw buffers which must be large enough for the worst case:
+// len code units for UTF-8 -> UTF-16/32, 3 * len bytes for UTF-16 -> UTF-8, and
+// 4 * len bytes for UTF-32 -> UTF-8. Returns the number of code units written or
+// kInvalidUTF if the input is malformed.
+uint32_t utf8_to_utf16(const char* str, uint32_t len, uint16_t* dst);
+uint32_t utf8_to_utf32(const char* str, uint32_t len, uint32_t* dst);
+uint32_t utf16_to_utf8(const uint16_t* str, uint32_t len, char* dst);
+uint32_t utf32_to_utf8(const uint32_t* str, uint32_t len, char* dst);
+
+// Transcoding which appends to the specified container. On failure (malformed input)
+// the container is left unchanged and false is returned.
+template<GetAllocatorFunc A>
+bool utf8_to_utf16(const char* str, uint32_t len, vector<uint16_t, A>& out);
+
+template<GetAllocatorFunc A>
+bool utf8_to_utf32(const char* str, uint32_t len, vector<uint32_t, A>& out);
+
+bool utf16_to_utf8(const uint16_t* str, uint32_t len, string& out);
+bool utf32_to_utf8(const uint32_t* str, uint32_t len, string& out);
+
+// Forward iterator over the code points of a UTF-8 string. Invalid sequences produce
+// kUnicodeReplacementChar and advance by a single byte.
+class utf8_iterator
+{
+public:
+	utf8_iterator(const char* ptr, const char* end);
+
+	uint32_t operator * () const;
+	utf8_iterator& operator ++ ();
+
+	bool operator == (const utf8_iterator& other) const;
+	bool operator != (const utf8_iterator& other) const;
+
+	const char* getPtr() const;
+
+private:
+	const char* m_Ptr;
+	const char* m_End;
+	uint32_t m_CodePoint;
+	uint32_t m_Length;
+
+	void decode();
+};
+
+// Range adapter for range-based for loops, e.g. for (uint32_t cp : utf8_range(str)) {...}
+class utf8_range
+{
+public:
+	utf8_range(const char* str, uint32_t len);
+	explicit utf8_range(const string& str);
+
+	utf8_iterator begin() const;
+	utf8_iterator end() const;
+
+private:
+	const char* m_Begin;
+	const char* m_End;
+};
+
+template<GetAllocatorFunc A>
+inline bool utf8_to_utf16(const char* str, uint32_t len, vector<uint16_t, A>& out)
+{
+	const uint32_t size = out.size();
+	out.resize(size + len);
+
+	const uint32_t n = utf8_to_utf16(str, len, out.begin() + size);
+	if (n == kInvalidUTF) {
+		out.resize(size);
+		return false;
+	}
+
+	out.resize(size + n);
+	return true;
+}
+
+template<GetAllocatorFunc A>
+inline bool utf8_to_utf32(const char* str, uint32_t len, vector<uint32_t, A>& out)
+{
+	const uint32_t size = out.size();
+	out.resize(size + len);
+
+	const uint32_t n = utf8_to_utf32(str, len, out.begin() + size);
+	if (n == kInvalidUTF) {
+		out.resize(size);
+		return false;
+	}
+
+	out.resize(size + n);
+	return true;
+}
+
+inline bool utf16_to_utf8(const uint16_t* str, uint32_t len, string& out)
+{
+	if (!len) {
+		return true;
+	}
+
+	const uint32_t size = out.size();
+	out.resize(size + len * 3);
+
+	const uint32_t n = utf16_to_utf8(str, len, &out[0] + size);
+	out.resize(n == kInvalidUTF ? size : size + n);
+	return n != kInvalidUTF;
+}
+
+inline bool utf32_to_utf8(const uint32_t* str, uint32_t len, string& out)
+{
+	if (!len) {
+		return true;
+	}
+
+	const uint32_t size = out.size();
+	out.resize(size + len * 4);
+
+	const uint32_t n = utf32_to_utf8(str, len, &out[0] + size);
+	out.resize(n == kInvalidUTF ? size : size + n);
+	return n != kInvalidUTF;
+}
+
+inline utf8_iterator::utf8_iterator(const char* ptr, const char* end)
+	: m_Ptr(ptr)
+	, m_End(end)
+	, m_CodePoint(0)
+	, m_Length(0)
+{
+	decode();
+}
+
+inline uint32_t utf8_iterator::operator * () const
+{
+	return m_CodePoint;
+}
+
+inline utf8_iterator& utf8_iterator::operator ++ ()
+{
+	m_Ptr += m_Length;
+	decode();
+	return *this;
+}
+
+inline bool utf8_iterator::operator == (const utf8_iterator& other) const
+{
+	return m_Ptr == other.m_Ptr;
+}
+
+inline bool utf8_iterator::operator != (const utf8_iterator& other) const
+{
+	return m_Ptr != other.m_Ptr;
+}
+
+inline const char* utf8_iterator::getPtr() const
+{
+	return m_Ptr;
+}
+
+inline void utf8_iterator::decode()
+{
+	if (m_Ptr == m_End) {
+		m_Length = 0;
+		return;
+	}
+
+	const uint8_t ch = (uint8_t)*m_Ptr;
+	if (ch < 0x80) {
+		m_CodePoint = ch;
+		m_Length = 1;
+	} else {
+		m_Length = utf8_decode(m_Ptr, (uint32_t)(m_End - m_Ptr), m_CodePoint);
+		m_Length = m_Length ? m_Length : 1;
+	}
+}
+
+inline utf8_range::utf8_range(const char* str, uint32_t len)
+	: m_Begin(str)
+	, m_End(str + len)
+{
+}
+
+inline utf8_range::utf8_range(const string& str)
+	: m_Begin(str.c_str())
+	, m_End(str.c_str() + str.size())
+{
+}
+
+inline utf8_iterator utf8_range::begin() const
+{
+	return utf8_iterator(m_Begin, m_End);
+}
+
+inline utf8_iterator utf8_range::end() const
+{
+	return utf8_iterator(m_End, m_End);
+}
+}
+
+#endif
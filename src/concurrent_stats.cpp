@@ -0,0 +1,184 @@
+#include <stdint.h>
+#include <bx/bx.h>
+#include <bx/allocator.h>
+#include <bx/cpu.h>
+#include "../include/jtl/concurrent_stats.h"
+#include "../include/jtl/atomic.h"
+
+#include <thread>
+
+namespace jtl
+{
+static const uint32_t kUnassignedSlot = ~0u;
+
+static uint64_t s_UsedThreadSlots = 0;
+static thread_local uint32_t s_ThreadSlot = kUnassignedSlot;
+
+// Releases the slot of the thread when it exits.
+struct ThreadSlotOwner
+{
+	uint32_t m_Slot;
+
+	ThreadSlotOwner()
+		: m_Slot(kMaxThreadSlots)
+	{
+	}
+
+	~ThreadSlotOwner()
+	{
+		if (m_Slot < kMaxThreadSlots) {
+			bx::atomicFetchAndSub<uint64_t>(&s_UsedThreadSlots, 1ull << m_Slot);
+		}
+
+		// Values recorded by destructors running after this one go to the shared shards.
+		s_ThreadSlot = kMaxThreadSlots;
+	}
+};
+
+static thread_local ThreadSlotOwner s_ThreadSlotOwner;
+
+static uint32_t assignThreadSlot()
+{
+	uint32_t slot = kMaxThreadSlots;
+	uint64_t usedSlots = atomicLoad(&s_UsedThreadSlots);
+	while (usedSlots != ~0ull) {
+		const uint32_t freeSlot = (uint32_t)bx::uint64_cnttz(~usedSlots);
+		const uint64_t prev = bx::atomicCompareAndSwap<uint64_t>(&s_UsedThreadSlots, usedSlots, usedSlots | (1ull << freeSlot));
+		if (prev == usedSlots) {
+			slot = freeSlot;
+			break;
+		}
+		usedSlots = prev;
+	}
+
+	// Accessing the owner constructs it and registers its destructor for this thread.
+	s_ThreadSlotOwner.m_Slot = slot;
+	s_ThreadSlot = slot;
+	return slot;
+}
+
+uint32_t getThreadSlot()
+{
+	const uint32_t slot = s_ThreadSlot;
+	return BX_LIKELY(slot != kUnassignedSlot) ? slot : assignThreadSlot();
+}
+
+void sharedShardLock(int32_t* lock)
+{
+	while (bx::atomicCompareAndSwap<int32_t>(lock, 0, 1) != 0) {
+		std::this_thread::yield();
+	}
+}
+
+void sharedShardUnlock(int32_t* lock)
+{
+	bx::atomicFetchAndSub<int32_t>(lock, 1);
+}
+
+concurrent_stats::concurrent_stats(bx::AllocatorI* allocator)
+	: m_Allocator(allocator ? allocator : getDefaultAllocator())
+	, m_Generation(0)
+	, m_SharedLock(0)
+{
+	bx::memSet(m_Shards, 0, sizeof(m_Shards));
+	createShard(kMaxThreadSlots);
+}
+
+concurrent_stats::~concurrent_stats()
+{
+	for (uint32_t i = 0; i <= kMaxThreadSlots; ++i) {
+		if (m_Shards[i]) {
+			BX_ALIGNED_FREE(m_Allocator, m_Shards[i], BX_CACHE_LINE_SIZE);
+		}
+	}
+}
+
+void concurrent_stats::read(stats_snapshot& snapshot) const
+{
+	snapshot = stats_snapshot();
+	for (uint32_t i = 0; i <= kMaxThreadSlots; ++i) {
+		const StatsShard* shard = atomicLoad(&m_Shards[i]);
+		if (!shard) {
+			continue;
+		}
+
+		stats_snapshot shardSnapshot;
+		shardSnapshot.m_Count = atomicLoad(&shard->m_Count);
+		shardSnapshot.m_Sum = atomicLoad(&shard->m_Sum);
+		shardSnapshot.m_SumSq = atomicLoad(&shard->m_SumSq);
+		shardSnapshot.m_Min = atomicLoad(&shard->m_Min);
+		shardSnapshot.m_Max = atomicLoad(&shard->m_Max);
+		snapshot.merge(shardSnapshot);
+	}
+}
+
+void concurrent_stats::drain(stats_snapshot& snapshot)
+{
+	// Start a new interval. Shards still in the previous one, or which have already
+	// started the new one, contribute their interval bounds (a value recorded across the
+	// switch may be accounted for in both intervals, never in none).
+	const uint32_t generation = m_Generation;
+	atomicStore(&m_Generation, generation + 1);
+	bx::memoryBarrier();
+
+	stats_snapshot totals;
+	double minValue = 0.0;
+	double maxValue = 0.0;
+	bool hasBounds = false;
+	for (uint32_t i = 0; i <= kMaxThreadSlots; ++i) {
+		const StatsShard* shard = atomicLoad(&m_Shards[i]);
+		if (!shard) {
+			continue;
+		}
+
+		const uint64_t count = atomicLoad(&shard->m_Count);
+		totals.m_Count += count;
+		totals.m_Sum += atomicLoad(&shard->m_Sum);
+		totals.m_SumSq += atomicLoad(&shard->m_SumSq);
+
+		const uint32_t shardGeneration = atomicLoad(&shard->m_Generation);
+		if (count && (shardGeneration == generation || shardGeneration == generation + 1)) {
+			const double shardMin = atomicLoad(&shard->m_IntervalMin);
+			const double shardMax = atomicLoad(&shard->m_IntervalMax);
+			minValue = hasBounds ? bx::min(minValue, shardMin) : shardMin;
+			maxValue = hasBounds ? bx::max(maxValue, shardMax) : shardMax;
+			hasBounds = true;
+		}
+	}
+
+	snapshot.m_Count = totals.m_Count - m_Drained.m_Count;
+	snapshot.m_Sum = snapshot.m_Count ? totals.m_Sum - m_Drained.m_Sum : 0.0;
+	snapshot.m_SumSq = snapshot.m_Count ? totals.m_SumSq - m_Drained.m_SumSq : 0.0;
+	if (!snapshot.m_Count) {
+		snapshot.m_Min = 0.0;
+		snapshot.m_Max = 0.0;
+	} else if (hasBounds) {
+		snapshot.m_Min = minValue;
+		snapshot.m_Max = maxValue;
+	} else {
+		snapshot.m_Min = snapshot.getMean();
+		snapshot.m_Max = snapshot.m_Min;
+	}
+
+	m_Drained = totals;
+}
+
+StatsShard* concurrent_stats::createShard(uint32_t slot)
+{
+	StatsShard* shard = (StatsShard*)BX_ALIGNED_ALLOC(m_Allocator, sizeof(StatsShard), BX_CACHE_LINE_SIZE);
+	JTL_CHECK(shard, "Allocation failed");
+	bx::memSet(shard, 0, sizeof(StatsShard));
+	shard->m_Generation = ~0u;
+
+	// Only the thread owning the slot creates its shard.
+	atomicStore(&m_Shards[slot], shard);
+	return shard;
+}
+
+void concurrent_stats::recordShared(double value)
+{
+	sharedShardLock(&m_SharedLock);
+	recordShard(m_Shards[kMaxThreadSlots], value, atomicLoad(&m_Generation));
+	sharedShardUnlock(&m_SharedLock);
+}
+}
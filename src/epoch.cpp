@@ -0,0 +1,332 @@
+#include <stdint.h>
+#include <bx/bx.h>
+#include <bx/allocator.h>
+#include <bx/cpu.h>
+#include <bx/math.h> // bx::uint32_cnttz()
+#include "../include/jtl/epoch.h"
+#include "../include/jtl/atomic.h"
+#include <stdlib.h> // abort()
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+namespace jtl
+{
+// Per thread and domain state. m_State is 0 when the thread isn't inside a critical
+// section, otherwise (epoch << 1) | 1 with the epoch observed when entering it.
+struct EpochRecord
+{
+	EpochRecord* m_Next;
+	uint32_t m_State;
+	uint32_t m_Nesting;
+	int32_t m_InUse;
+};
+
+struct EpochCollector
+{
+	std::thread m_Thread;
+	std::mutex m_Mutex;
+	std::condition_variable m_CondVar;
+	bool m_Stop;
+};
+
+static uint32_t s_UsedSlots = 0;
+static uint32_t s_NextGeneration = 0;
+static uint32_t s_SlotGenerations[epoch_domain::kMaxDomains];
+
+// Records are released when the thread exits so they can be reused by other threads.
+struct EpochThreadState
+{
+	uint32_t m_Generations[epoch_domain::kMaxDomains];
+	EpochRecord* m_Records[epoch_domain::kMaxDomains];
+
+	EpochThreadState()
+	{
+		bx::memSet(m_Generations, 0, sizeof(m_Generations));
+		bx::memSet(m_Records, 0, sizeof(m_Records));
+	}
+
+	~EpochThreadState()
+	{
+		for (uint32_t i = 0; i < epoch_domain::kMaxDomains; ++i) {
+			if (m_Records[i] && m_Generations[i] == atomicLoad(&s_SlotGenerations[i])) {
+				atomicStore(&m_Records[i]->m_State, 0u);
+				m_Records[i]->m_Nesting = 0;
+				atomicStore(&m_Records[i]->m_InUse, 0);
+			}
+		}
+	}
+};
+
+static thread_local EpochThreadState s_ThreadState;
+
+static inline uint32_t makeState(uint32_t epoch)
+{
+	return (epoch << 1) | 1;
+}
+
+epoch_domain::epoch_domain(bx::AllocatorI* allocator)
+	: m_Allocator(allocator ? allocator : getDefaultAllocator())
+	, m_Records(nullptr)
+	, m_Retired(nullptr)
+	, m_Pending(nullptr)
+	, m_Collector(nullptr)
+	, m_Epoch(0)
+	, m_Collecting(0)
+	, m_Slot(kMaxDomains)
+	, m_Generation(0)
+{
+	uint32_t usedSlots = atomicLoad(&s_UsedSlots);
+	for (;;) {
+		const uint32_t slot = bx::uint32_cnttz(~usedSlots);
+		JTL_CHECK(slot < kMaxDomains, "Too many epoch domains");
+		if (slot >= kMaxDomains) {
+			// Thread states are indexed by slot; the domain can't work without one.
+			::abort();
+		}
+
+		const uint32_t prev = bx::atomicCompareAndSwap<uint32_t>(&s_UsedSlots, usedSlots, usedSlots | (1u << slot));
+		if (prev == usedSlots) {
+			m_Slot = slot;
+			break;
+		}
+		usedSlots = prev;
+	}
+
+	m_Generation = bx::atomicAddAndFetch<uint32_t>(&s_NextGeneration, 1);
+	atomicStore(&s_SlotGenerations[m_Slot], m_Generation);
+}
+
+epoch_domain::~epoch_domain()
+{
+	stop();
+
+	// Nobody can be inside a critical section anymore, so everything can be reclaimed.
+	epoch_retired* item = m_Pending;
+	while (item) {
+		epoch_retired* next = item->m_Next;
+		item->m_Reclaim(item);
+		item = next;
+	}
+
+	// Reclaiming objects might retire more objects.
+	while ((item = atomicExchangePtr(&m_Retired, (epoch_retired*)nullptr)) != nullptr) {
+		while (item) {
+			epoch_retired* next = item->m_Next;
+			item->m_Reclaim(item);
+			item = next;
+		}
+	}
+
+	EpochRecord* record = m_Records;
+	while (record) {
+		EpochRecord* next = record->m_Next;
+		BX_FREE(m_Allocator, record);
+		record = next;
+	}
+
+	if (m_Slot < kMaxDomains) {
+		atomicStore(&s_SlotGenerations[m_Slot], 0u);
+		bx::atomicFetchAndSub<uint32_t>(&s_UsedSlots, 1u << m_Slot);
+	}
+}
+
+void epoch_domain::enter()
+{
+	EpochRecord* record = getRecord();
+	if (record->m_Nesting++ == 0) {
+		atomicStore(&record->m_State, makeState(atomicLoad(&m_Epoch)));
+
+		// The state must be visible to collectors before any shared object is read.
+		bx::memoryBarrier();
+	}
+}
+
+void epoch_domain::leave()
+{
+	EpochRecord* record = getRecord();
+	JTL_CHECK(record->m_Nesting != 0, "leave() without enter()");
+	if (--record->m_Nesting == 0) {
+		atomicStore(&record->m_State, 0u);
+	}
+}
+
+void epoch_domain::retire(epoch_retired* item)
+{
+	item->m_Epoch = atomicLoad(&m_Epoch);
+
+	epoch_retired* head = atomicLoad(&m_Retired);
+	for (;;) {
+		item->m_Next = head;
+		epoch_retired* prev = atomicCompareAndSwapPtr(&m_Retired, head, item);
+		if (prev == head) {
+			break;
+		}
+		head = prev;
+	}
+}
+
+uint32_t epoch_domain::collect()
+{
+	if (bx::atomicCompareAndSwap<int32_t>(&m_Collecting, 0, 1) != 0) {
+		return 0;
+	}
+
+	uint32_t epoch;
+	tryAdvance(epoch);
+
+	// Move newly retired objects to the pending list (taking the whole stack at once
+	// avoids ABA issues).
+	epoch_retired* item = atomicExchangePtr(&m_Retired, (epoch_retired*)nullptr);
+	while (item) {
+		epoch_retired* next = item->m_Next;
+		item->m_Next = m_Pending;
+		m_Pending = item;
+		item = next;
+	}
+
+	// Unlink everything that's safe to reclaim first, since reclaiming objects might
+	// retire more objects.
+	epoch_retired* reclaimable = nullptr;
+	epoch_retired** link = &m_Pending;
+	while (*link) {
+		item = *link;
+		if (epoch - item->m_Epoch >= 2) {
+			*link = item->m_Next;
+			item->m_Next = reclaimable;
+			reclaimable = item;
+		} else {
+			link = &item->m_Next;
+		}
+	}
+
+	uint32_t numReclaimed = 0;
+	while (reclaimable) {
+		epoch_retired* next = reclaimable->m_Next;
+		reclaimable->m_Reclaim(reclaimable);
+		reclaimable = next;
+		++numReclaimed;
+	}
+
+	atomicStore(&m_Collecting, 0);
+
+	return numReclaimed;
+}
+
+void epoch_domain::start(uint32_t intervalMs)
+{
+	if (m_Collector) {
+		return;
+	}
+
+	EpochCollector* collector = BX_NEW(m_Allocator, EpochCollector);
+	collector->m_Stop = false;
+	collector->m_Thread = std::thread([this, collector, intervalMs]() {
+		std::unique_lock<std::mutex> lock(collector->m_Mutex);
+		while (!collector->m_Stop) {
+			lock.unlock();
+			collect();
+			lock.lock();
+			collector->m_CondVar.wait_for(lock, std::chrono::milliseconds(intervalMs));
+		}
+	});
+
+	m_Collector = collector;
+}
+
+void epoch_domain::stop()
+{
+	EpochCollector* collector = m_Collector;
+	if (!collector) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(collector->m_Mutex);
+		collector->m_Stop = true;
+	}
+	collector->m_CondVar.notify_one();
+	collector->m_Thread.join();
+
+	BX_DELETE(m_Allocator, collector);
+	m_Collector = nullptr;
+}
+
+EpochRecord* epoch_domain::getRecord()
+{
+	EpochThreadState& state = s_ThreadState;
+	if (state.m_Generations[m_Slot] != m_Generation) {
+		state.m_Records[m_Slot] = acquireRecord();
+		state.m_Generations[m_Slot] = m_Generation;
+	}
+
+	return state.m_Records[m_Slot];
+}
+
+// Reuses a record released by an exited thread or allocates a new one. Records are
+// only freed when the domain is destroyed, so the list is push-only.
+EpochRecord* epoch_domain::acquireRecord()
+{
+	for (EpochRecord* record = atomicLoad(&m_Records); record; record = record->m_Next) {
+		if (!atomicLoad(&record->m_InUse) && bx::atomicCompareAndSwap<int32_t>(&record->m_InUse, 0, 1) == 0) {
+			return record;
+		}
+	}
+
+	EpochRecord* record = (EpochRecord*)BX_ALLOC(m_Allocator, sizeof(EpochRecord));
+	JTL_CHECK(record, "Allocation failed");
+	record->m_State = 0;
+	record->m_Nesting = 0;
+	record->m_InUse = 1;
+
+	EpochRecord* head = atomicLoad(&m_Records);
+	for (;;) {
+		record->m_Next = head;
+		EpochRecord* prev = atomicCompareAndSwapPtr(&m_Records, head, record);
+		if (prev == head) {
+			break;
+		}
+		head = prev;
+	}
+
+	return record;
+}
+
+// The epoch can advance once every thread inside a critical section has observed it.
+bool epoch_domain::tryAdvance(uint32_t& epoch)
+{
+	epoch = atomicLoad(&m_Epoch);
+	bx::memoryBarrier();
+
+	const uint32_t current = makeState(epoch);
+	for (EpochRecord* record = atomicLoad(&m_Records); record; record = record->m_Next) {
+		const uint32_t state = atomicLoad(&record->m_State);
+		if (state != 0 && state != current) {
+			return false;
+		}
+	}
+
+	// Only the collector advances the epoch.
+	atomicStore(&m_Epoch, epoch + 1);
+	bx::memoryBarrier();
+	++epoch;
+	return true;
+}
+
+static epoch_domain* createDefaultEpochDomain()
+{
+	static uint64_t buffer[(sizeof(epoch_domain) + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+	epoch_domain* domain = BX_PLACEMENT_NEW(buffer, epoch_domain)(getDefaultAllocator());
+	domain->start();
+	return domain;
+}
+
+epoch_domain* getDefaultEpochDomain()
+{
+	// The initialization of the local static is thread safe.
+	static epoch_domain* domain = createDefaultEpochDomain();
+	return domain;
+}
+}
@@ -0,0 +1,199 @@
+#include <stdint.h>
+#include <bx/bx.h>
+#include <bx/allocator.h>
+#include <bx/cpu.h>
+#include "../include/jtl/future.h"
+#include "../include/jtl/atomic.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace jtl
+{
+static const uint32_t kWaitSpinCount = 64;
+
+// Continuation used by threads which block in futureWait(). It lives on the waiting
+// thread's stack and is run inline by the completing thread.
+struct FutureWaiter : public scheduler_task
+{
+	std::mutex m_Mutex;
+	std::condition_variable m_CondVar;
+	bool m_Done;
+
+	static void execute(scheduler_task* task)
+	{
+		FutureWaiter* waiter = static_cast<FutureWaiter*>(task);
+		std::lock_guard<std::mutex> lock(waiter->m_Mutex);
+		waiter->m_Done = true;
+		waiter->m_CondVar.notify_one();
+	}
+};
+
+struct FutureCombinatorNode : public scheduler_task
+{
+	FutureCombinator* m_Combinator;
+	uint32_t m_Index;
+};
+
+// Shared by the continuations installed on all the input futures, and freed when the
+// last of them has run.
+struct FutureCombinator
+{
+	bx::AllocatorI* m_Allocator;
+	promise<void> m_AllPromise;
+	promise<uint32_t> m_AnyPromise;
+	int32_t m_RefCount;
+	int32_t m_Done;
+	bool m_Any;
+
+	FutureCombinatorNode* getNodes()
+	{
+		return (FutureCombinatorNode*)(this + 1);
+	}
+};
+
+static void dispatch(scheduler_task* continuation, scheduler* sched)
+{
+	if (sched) {
+		sched->submit(continuation);
+	} else {
+		continuation->m_Execute(continuation);
+	}
+}
+
+static void combinatorNodeExecute(scheduler_task* task)
+{
+	FutureCombinatorNode* node = static_cast<FutureCombinatorNode*>(task);
+	FutureCombinator* combinator = node->m_Combinator;
+
+	// The combinator can't be accessed anymore after dropping the reference, unless it
+	// was the last one.
+	if (combinator->m_Any && bx::atomicCompareAndSwap<int32_t>(&combinator->m_Done, 0, 1) == 0) {
+		combinator->m_AnyPromise.set_value(node->m_Index);
+	}
+
+	if (bx::atomicSubAndFetch<int32_t>(&combinator->m_RefCount, 1) == 0) {
+		if (!combinator->m_Any) {
+			combinator->m_AllPromise.set_value();
+		}
+
+		bx::AllocatorI* allocator = combinator->m_Allocator;
+		combinator->~FutureCombinator();
+		BX_FREE(allocator, combinator);
+	}
+}
+
+static FutureCombinator* createCombinator(uint32_t count, bool any)
+{
+	bx::AllocatorI* allocator = getPoolAllocator();
+	void* mem = BX_ALLOC(allocator, sizeof(FutureCombinator) + sizeof(FutureCombinatorNode) * count);
+	JTL_CHECK(mem, "Allocation failed");
+
+	FutureCombinator* combinator = BX_PLACEMENT_NEW(mem, FutureCombinator)();
+	combinator->m_Allocator = allocator;
+	combinator->m_RefCount = (int32_t)count;
+	combinator->m_Done = 0;
+	combinator->m_Any = any;
+
+	FutureCombinatorNode* nodes = combinator->getNodes();
+	for (uint32_t i = 0; i < count; ++i) {
+		nodes[i].m_Next = nullptr;
+		nodes[i].m_Execute = combinatorNodeExecute;
+		nodes[i].m_Combinator = combinator;
+		nodes[i].m_Index = i;
+	}
+
+	// The promise that isn't used must still be fulfilled before being destroyed.
+	if (any) {
+		combinator->m_AllPromise.set_value();
+	} else {
+		combinator->m_AnyPromise.set_value(0u);
+	}
+
+	return combinator;
+}
+
+void futureComplete(FutureStateBase* state)
+{
+	// The value must be visible before the state is marked as ready.
+	scheduler_task* continuation = atomicExchangePtr(&state->m_Continuation, kFutureReady);
+	JTL_CHECK(continuation != kFutureReady, "Future completed twice");
+	if (continuation) {
+		dispatch(continuation, state->m_Scheduler);
+	}
+}
+
+void futureAttach(FutureStateBase* state, scheduler_task* continuation, scheduler* sched)
+{
+	state->m_Scheduler = sched;
+
+	scheduler_task* prev = atomicCompareAndSwapPtr(&state->m_Continuation, (scheduler_task*)nullptr, continuation);
+	if (prev == kFutureReady) {
+		dispatch(continuation, sched);
+	} else {
+		JTL_CHECK(prev == nullptr, "Future already has a continuation");
+	}
+}
+
+void futureWait(FutureStateBase* state)
+{
+	// Worker threads keep running tasks (possibly the one which completes the state)
+	// instead of blocking.
+	scheduler* sched = getCurrentScheduler();
+	if (sched) {
+		while (!futureIsReady(state)) {
+			if (!sched->tryRunOne()) {
+				std::this_thread::yield();
+			}
+		}
+		return;
+	}
+
+	for (uint32_t i = 0; i < kWaitSpinCount; ++i) {
+		if (futureIsReady(state)) {
+			return;
+		}
+		std::this_thread::yield();
+	}
+
+	FutureWaiter waiter;
+	waiter.m_Next = nullptr;
+	waiter.m_Execute = FutureWaiter::execute;
+	waiter.m_Done = false;
+	futureAttach(state, &waiter, nullptr);
+
+	std::unique_lock<std::mutex> lock(waiter.m_Mutex);
+	while (!waiter.m_Done) {
+		waiter.m_CondVar.wait(lock);
+	}
+}
+
+FutureCombinator* createWhenAll(uint32_t count, future<void>& result)
+{
+	FutureCombinator* combinator = createCombinator(count, false);
+	result = combinator->m_AllPromise.get_future();
+	if (!count) {
+		combinator->m_AllPromise.set_value();
+
+		bx::AllocatorI* allocator = combinator->m_Allocator;
+		combinator->~FutureCombinator();
+		BX_FREE(allocator, combinator);
+		return nullptr;
+	}
+
+	return combinator;
+}
+
+FutureCombinator* createWhenAny(uint32_t count, future<uint32_t>& result)
+{
+	FutureCombinator* combinator = createCombinator(count, true);
+	result = combinator->m_AnyPromise.get_future();
+	return combinator;
+}
+
+void attachCombinator(FutureCombinator* combinator, uint32_t index, FutureStateBase* state)
+{
+	futureAttach(state, &combinator->getNodes()[index], nullptr);
+}
+}
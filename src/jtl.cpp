@@ -1,12 +1,16 @@
 #include <bx/allocator.h>
+#include "../include/jtl/jtl.h"
+#include "../include/jtl/atomic.h"
 
 namespace jtl
 {
 #define FNV_32_PRIME 0x01000193u
 #define	FNV1_32_INIT 0x811C9DC5u
 
-// TODO: Configurable default allocator.
-bx::AllocatorI* getDefaultAllocator()
+static bx::AllocatorI* s_DefaultAllocator = nullptr;
+static thread_local bx::AllocatorI* s_ScopedAllocator = nullptr;
+
+static bx::AllocatorI* getSystemAllocator()
 {
 	static char buffer[sizeof(bx::DefaultAllocator)];
 	static bx::DefaultAllocator* defaultAllocator = nullptr;
@@ -16,6 +20,31 @@ bx::AllocatorI* getDefaultAllocator()
 	return defaultAllocator;
 }
 
+bx::AllocatorI* getDefaultAllocator()
+{
+	bx::AllocatorI* allocator = atomicLoad(&s_DefaultAllocator);
+	return allocator ? allocator : getSystemAllocator();
+}
+
+bx::AllocatorI* setDefaultAllocator(bx::AllocatorI* allocator)
+{
+	bx::AllocatorI* prev = atomicExchangePtr(&s_DefaultAllocator, allocator);
+	return prev ? prev : getSystemAllocator();
+}
+
+bx::AllocatorI* getScopedAllocator()
+{
+	bx::AllocatorI* allocator = s_ScopedAllocator;
+	return allocator ? allocator : getDefaultAllocator();
+}
+
+bx::AllocatorI* setScopedAllocator(bx::AllocatorI* allocator)
+{
+	bx::AllocatorI* prev = s_ScopedAllocator;
+	s_ScopedAllocator = allocator;
+	return prev;
+}
+
 uint32_t fnv1a(const void* buffer, uint32_t len)
 {
 	const uint8_t* s = (const uint8_t*)buffer;
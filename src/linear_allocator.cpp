@@ -0,0 +1,212 @@
+#include <stdint.h>
+#include <bx/bx.h>
+#include <bx/allocator.h>
+#include "../include/jtl/linear_allocator.h"
+
+namespace jtl
+{
+static const size_t kMinAlignment = 16;
+static const size_t kHeaderSize = sizeof(uint64_t);
+
+struct LinearBlock
+{
+	LinearBlock* m_Next;
+	size_t m_Size; // Usable size, following the (16 byte) block header
+};
+
+static inline uint8_t* getBlockData(LinearBlock* block)
+{
+	return (uint8_t*)block + sizeof(LinearBlock);
+}
+
+static inline uint64_t& getAllocSize(void* ptr)
+{
+	return *(uint64_t*)((uint8_t*)ptr - kHeaderSize);
+}
+
+linear_allocator::linear_allocator(size_t blockSize, bx::AllocatorI* backingAllocator)
+	: m_BackingAllocator(backingAllocator ? backingAllocator : getDefaultAllocator())
+	, m_FirstBlock(nullptr)
+	, m_LastBlock(nullptr)
+	, m_CurrentBlock(nullptr)
+	, m_LastAlloc(nullptr)
+	, m_LastAllocOffset(0)
+	, m_Offset(0)
+	, m_BlockSize(blockSize)
+{
+}
+
+linear_allocator::~linear_allocator()
+{
+	release();
+}
+
+void* linear_allocator::realloc(void* _ptr, size_t _size, size_t _align, const char* _file, uint32_t _line)
+{
+	BX_UNUSED(_file, _line);
+
+	if (!_size) {
+		free(_ptr);
+		return nullptr;
+	} else if (!_ptr) {
+		return alloc(_size, _align);
+	}
+
+	if (tryResize(_ptr, _size)) {
+		return _ptr;
+	}
+
+	void* ptr = alloc(_size, _align);
+	if (ptr) {
+		const size_t oldSize = (size_t)getAllocSize(_ptr);
+		bx::memCopy(ptr, _ptr, oldSize < _size ? oldSize : _size);
+	}
+	return ptr;
+}
+
+linear_allocator::marker linear_allocator::getMarker() const
+{
+	marker m;
+	m.m_Block = m_CurrentBlock;
+	m.m_Offset = m_Offset;
+	return m;
+}
+
+void linear_allocator::rewind(const marker& m)
+{
+	// A marker taken before the first allocation rewinds to the beginning of the first
+	// block.
+	m_CurrentBlock = m.m_Block ? m.m_Block : m_FirstBlock;
+	m_Offset = m.m_Block ? m.m_Offset : 0;
+	m_LastAlloc = nullptr;
+}
+
+void linear_allocator::reset()
+{
+	m_CurrentBlock = m_FirstBlock;
+	m_Offset = 0;
+	m_LastAlloc = nullptr;
+}
+
+void linear_allocator::release()
+{
+	LinearBlock* block = m_FirstBlock;
+	while (block) {
+		LinearBlock* next = block->m_Next;
+		BX_FREE(m_BackingAllocator, block);
+		block = next;
+	}
+
+	m_FirstBlock = nullptr;
+	m_LastBlock = nullptr;
+	m_CurrentBlock = nullptr;
+	m_LastAlloc = nullptr;
+	m_Offset = 0;
+}
+
+size_t linear_allocator::getCapacity() const
+{
+	size_t capacity = 0;
+	for (LinearBlock* block = m_FirstBlock; block; block = block->m_Next) {
+		capacity += block->m_Size;
+	}
+	return capacity;
+}
+
+void* linear_allocator::alloc(size_t size, size_t align)
+{
+	align = align > kMinAlignment ? align : kMinAlignment;
+
+	for (;;) {
+		LinearBlock* block = m_CurrentBlock;
+		if (block) {
+			uint8_t* data = getBlockData(block);
+			const uintptr_t start = (uintptr_t)data + m_Offset + kHeaderSize;
+			const uintptr_t ptr = (start + align - 1) & ~(uintptr_t)(align - 1);
+			const size_t end = (size_t)(ptr - (uintptr_t)data) + size;
+			if (end <= block->m_Size) {
+				getAllocSize((void*)ptr) = size;
+				m_LastAlloc = (void*)ptr;
+				m_LastAllocOffset = m_Offset;
+				m_Offset = end;
+				return (void*)ptr;
+			}
+
+			// Blocks kept from before the last reset are reused in order.
+			if (block->m_Next) {
+				m_CurrentBlock = block->m_Next;
+				m_Offset = 0;
+				continue;
+			}
+		}
+
+		// The block data is 16 byte aligned; larger alignments might need padding.
+		const size_t minSize = size + kHeaderSize + (align > kMinAlignment ? align : 0) + kMinAlignment;
+		const size_t blockSize = minSize > m_BlockSize ? minSize : m_BlockSize;
+		LinearBlock* newBlock = (LinearBlock*)BX_ALLOC(m_BackingAllocator, sizeof(LinearBlock) + blockSize);
+		JTL_CHECK(newBlock, "Allocation failed");
+		if (!newBlock) {
+			return nullptr;
+		}
+
+		newBlock->m_Next = nullptr;
+		newBlock->m_Size = blockSize;
+		if (m_LastBlock) {
+			m_LastBlock->m_Next = newBlock;
+		} else {
+			m_FirstBlock = newBlock;
+		}
+		m_LastBlock = newBlock;
+		m_CurrentBlock = newBlock;
+		m_Offset = 0;
+	}
+}
+
+void linear_allocator::free(void* ptr)
+{
+	if (ptr && ptr == m_LastAlloc) {
+		m_Offset = m_LastAllocOffset;
+		m_LastAlloc = nullptr;
+	}
+}
+
+// Grows or shrinks the last allocation in place.
+bool linear_allocator::tryResize(void* ptr, size_t size)
+{
+	if (ptr != m_LastAlloc) {
+		return false;
+	}
+
+	const size_t end = (size_t)((uint8_t*)ptr - getBlockData(m_CurrentBlock)) + size;
+	if (end > m_CurrentBlock->m_Size) {
+		return false;
+	}
+
+	getAllocSize(ptr) = size;
+	m_Offset = end;
+	return true;
+}
+
+frame_allocator::frame_allocator(size_t blockSize, bx::AllocatorI* backingAllocator)
+	: m_Frames{ { blockSize, backingAllocator }, { blockSize, backingAllocator } }
+	, m_Current(0)
+{
+}
+
+frame_allocator::~frame_allocator()
+{
+}
+
+void* frame_allocator::realloc(void* _ptr, size_t _size, size_t _align, const char* _file, uint32_t _line)
+{
+	// Frees of the previous frame's memory are no-ops, and reallocating it copies it to
+	// the current frame.
+	return m_Frames[m_Current].realloc(_ptr, _size, _align, _file, _line);
+}
+
+void frame_allocator::nextFrame()
+{
+	m_Current ^= 1;
+	m_Frames[m_Current].reset();
+}
+}
@@ -0,0 +1,402 @@
+#include <stdint.h>
+#include <bx/bx.h>
+#include <bx/allocator.h>
+#include <bx/cpu.h>
+#include <bx/math.h> // bx::uint32_cnttz()
+#include "../include/jtl/pool_allocator.h"
+#include "../include/jtl/atomic.h"
+
+namespace jtl
+{
+static const uint32_t kHeaderSize = 16;
+static const uint32_t kMinAlignment = 16;
+static const uint32_t kLargeSizeClass = ~0u;
+
+// Every block starts with a 16-byte header. Small blocks keep their size class for their
+// whole life; while a small block is free, the beginning of its user area holds the links
+// below. The first block of a batch stores the number of blocks in the batch in m_Offset.
+struct PoolBlock
+{
+	uint32_t m_SizeClass;
+	uint32_t m_Offset; // Large blocks: distance from the backing allocation to the header
+	uint64_t m_Size;   // Large blocks: requested size
+
+	PoolBlock* m_Next;
+	PoolBlock* m_NextBatch;
+};
+
+struct PoolChunk
+{
+	PoolChunk* m_Next;
+	uint64_t m_Padding;
+};
+
+struct PoolThreadCache
+{
+	uint32_t m_Generation;
+	uint32_t m_Counts[16];
+	PoolBlock* m_Heads[16];
+};
+
+static const uint32_t s_ClassSizes[] =
+{
+	16, 32, 48, 64, 80, 96, 112, 128,
+	160, 192, 224, 256,
+	320, 384, 448, 512,
+};
+
+static uint32_t s_UsedSlots = 0;
+static uint32_t s_NextGeneration = 0;
+static pool_allocator* s_Pools[pool_allocator::kMaxPools];
+static thread_local PoolThreadCache s_ThreadCaches[pool_allocator::kMaxPools];
+
+// Returns the blocks cached by the thread to their pools when it exits. Kept separate from
+// the caches so that they stay trivially destructible (no TLS guard on every access).
+struct PoolThreadCacheOwner
+{
+	bool m_Registered;
+
+	PoolThreadCacheOwner()
+		: m_Registered(false)
+	{
+	}
+
+	~PoolThreadCacheOwner()
+	{
+		for (uint32_t i = 0; i < pool_allocator::kMaxPools; ++i) {
+			pool_allocator* pool = atomicLoad(&s_Pools[i]);
+			if (pool && pool->getGeneration() == s_ThreadCaches[i].m_Generation) {
+				pool->flushThreadCache();
+			}
+		}
+	}
+};
+
+static thread_local PoolThreadCacheOwner s_ThreadCacheOwner;
+
+static inline uint32_t getSizeClass(size_t size)
+{
+	if (size <= 128) {
+		return size ? (uint32_t)(size - 1) >> 4 : 0;
+	} else if (size <= 256) {
+		return 8 + ((uint32_t)(size - 129) >> 5);
+	}
+
+	return 12 + ((uint32_t)(size - 257) >> 6);
+}
+
+static inline PoolBlock* getBlock(void* ptr)
+{
+	return (PoolBlock*)((uint8_t*)ptr - kHeaderSize);
+}
+
+static inline void* getUserPtr(PoolBlock* block)
+{
+	return (uint8_t*)block + kHeaderSize;
+}
+
+// Batch stacks use tagged pointers (48-bit pointer + 16-bit tag) to avoid ABA. Popping
+// reads m_NextBatch of a block which might have been popped and reused by another
+// thread in the meantime; that's fine because chunks are never freed while the pool is
+// alive, and the tag makes the CAS fail in that case.
+static inline uint64_t packTagged(PoolBlock* ptr, uint64_t tag)
+{
+	return (uint64_t)(uintptr_t)ptr | (tag << 48);
+}
+
+static inline PoolBlock* unpackTagged(uint64_t tagged)
+{
+	return (PoolBlock*)(uintptr_t)(tagged & ((1ull << 48) - 1));
+}
+
+pool_allocator::pool_allocator(bx::AllocatorI* backingAllocator, uint32_t chunkSize)
+	: m_BackingAllocator(backingAllocator ? backingAllocator : getDefaultAllocator())
+	, m_Chunks(nullptr)
+	, m_ChunkSize(chunkSize)
+	, m_Slot(kMaxPools)
+	, m_Generation(0)
+{
+	JTL_CHECK(chunkSize >= sizeof(PoolChunk) + (kHeaderSize + kMaxBlockSize) * kBatchSize, "Chunk size too small");
+	bx::memSet(m_FreeBatches, 0, sizeof(m_FreeBatches));
+
+	// Thread caches are indexed by slot. Generations are never reused so caches left
+	// behind by a destroyed pool in the same slot are detected and discarded.
+	uint32_t usedSlots = atomicLoad(&s_UsedSlots);
+	for (;;) {
+		const uint32_t slot = bx::uint32_cnttz(~usedSlots);
+		JTL_CHECK(slot < kMaxPools, "Too many pools");
+		if (slot >= kMaxPools) {
+			return;
+		}
+
+		const uint32_t prev = bx::atomicCompareAndSwap<uint32_t>(&s_UsedSlots, usedSlots, usedSlots | (1u << slot));
+		if (prev == usedSlots) {
+			m_Slot = slot;
+			break;
+		}
+		usedSlots = prev;
+	}
+
+	m_Generation = bx::atomicAddAndFetch<uint32_t>(&s_NextGeneration, 1);
+	atomicStore(&s_Pools[m_Slot], this);
+}
+
+pool_allocator::~pool_allocator()
+{
+	if (m_Slot < kMaxPools) {
+		atomicStore(&s_Pools[m_Slot], (pool_allocator*)nullptr);
+	}
+
+	PoolChunk* chunk = (PoolChunk*)m_Chunks;
+	while (chunk) {
+		PoolChunk* next = chunk->m_Next;
+		BX_ALIGNED_FREE(m_BackingAllocator, chunk, kMinAlignment);
+		chunk = next;
+	}
+
+	if (m_Slot < kMaxPools) {
+		bx::atomicFetchAndSub<uint32_t>(&s_UsedSlots, 1u << m_Slot);
+	}
+}
+
+void* pool_allocator::realloc(void* _ptr, size_t _size, size_t _align, const char* _file, uint32_t _line)
+{
+	const bool small = _size <= kMaxBlockSize && _align <= kMinAlignment && m_Slot < kMaxPools;
+
+	if (!_ptr) {
+		if (!_size) {
+			return nullptr;
+		}
+
+		return small ? allocSmall(getSizeClass(_size)) : allocLarge(_size, _align, _file, _line);
+	}
+
+	PoolBlock* block = getBlock(_ptr);
+	const bool wasLarge = block->m_SizeClass == kLargeSizeClass;
+	if (!_size) {
+		if (wasLarge) {
+			freeLarge(block, _file, _line);
+		} else {
+			freeSmall(block);
+		}
+		return nullptr;
+	}
+
+	const size_t oldSize = wasLarge ? (size_t)block->m_Size : s_ClassSizes[block->m_SizeClass];
+	if (!wasLarge && small && _size <= oldSize) {
+		return _ptr;
+	}
+
+	void* newPtr = small ? allocSmall(getSizeClass(_size)) : allocLarge(_size, _align, _file, _line);
+	if (!newPtr) {
+		return nullptr;
+	}
+
+	bx::memCopy(newPtr, _ptr, bx::min(oldSize, _size));
+	if (wasLarge) {
+		freeLarge(block, _file, _line);
+	} else {
+		freeSmall(block);
+	}
+
+	return newPtr;
+}
+
+void pool_allocator::flushThreadCache()
+{
+	if (m_Slot >= kMaxPools) {
+		return;
+	}
+
+	PoolThreadCache* cache = getThreadCache();
+	for (uint32_t i = 0; i < kNumSizeClasses; ++i) {
+		if (cache->m_Heads[i]) {
+			pushBatch(i, cache->m_Heads[i], cache->m_Counts[i]);
+			cache->m_Heads[i] = nullptr;
+			cache->m_Counts[i] = 0;
+		}
+	}
+}
+
+void* pool_allocator::allocSmall(uint32_t sizeClass)
+{
+	PoolThreadCache* cache = getThreadCache();
+	PoolBlock* block = cache->m_Heads[sizeClass];
+	if (!block) {
+		uint32_t count;
+		block = refill(sizeClass, count);
+		if (!block) {
+			return nullptr;
+		}
+
+		cache->m_Counts[sizeClass] = count;
+	}
+
+	cache->m_Heads[sizeClass] = block->m_Next;
+	cache->m_Counts[sizeClass]--;
+
+	return getUserPtr(block);
+}
+
+void pool_allocator::freeSmall(PoolBlock* block)
+{
+	const uint32_t sizeClass = block->m_SizeClass;
+	JTL_CHECK(sizeClass < kNumSizeClasses, "Invalid block");
+
+	PoolThreadCache* cache = getThreadCache();
+	block->m_Next = cache->m_Heads[sizeClass];
+	cache->m_Heads[sizeClass] = block;
+
+	// Keep up to 2 batches per thread so alternating allocs and frees around the limit
+	// don't hit the global lists every time.
+	if (++cache->m_Counts[sizeClass] >= kBatchSize * 2) {
+		PoolBlock* last = block;
+		for (uint32_t i = 1; i < kBatchSize; ++i) {
+			last = last->m_Next;
+		}
+
+		cache->m_Heads[sizeClass] = last->m_Next;
+		cache->m_Counts[sizeClass] -= kBatchSize;
+		last->m_Next = nullptr;
+
+		pushBatch(sizeClass, block, kBatchSize);
+	}
+}
+
+void* pool_allocator::allocLarge(size_t size, size_t align, const char* file, uint32_t line)
+{
+	align = bx::max(align, (size_t)kMinAlignment);
+
+	uint8_t* mem = (uint8_t*)m_BackingAllocator->realloc(nullptr, size + kHeaderSize + align, 0, file, line);
+	if (!mem) {
+		return nullptr;
+	}
+
+	uint8_t* ptr = (uint8_t*)bx::alignPtr(mem, kHeaderSize, align);
+	PoolBlock* block = getBlock(ptr);
+	block->m_SizeClass = kLargeSizeClass;
+	block->m_Offset = (uint32_t)((uint8_t*)block - mem);
+	block->m_Size = size;
+
+	return ptr;
+}
+
+void pool_allocator::freeLarge(PoolBlock* block, const char* file, uint32_t line)
+{
+	m_BackingAllocator->realloc((uint8_t*)block - block->m_Offset, 0, 0, file, line);
+}
+
+PoolBlock* pool_allocator::refill(uint32_t sizeClass, uint32_t& count)
+{
+	PoolBlock* batch = popBatch(sizeClass, count);
+	return batch ? batch : allocChunk(sizeClass, count);
+}
+
+// Carves a new chunk into blocks. The first batch is returned and the rest is pushed to
+// the global list.
+PoolBlock* pool_allocator::allocChunk(uint32_t sizeClass, uint32_t& count)
+{
+	PoolChunk* chunk = (PoolChunk*)BX_ALIGNED_ALLOC(m_BackingAllocator, m_ChunkSize, kMinAlignment);
+	if (!chunk) {
+		return nullptr;
+	}
+
+	PoolChunk* head = (PoolChunk*)atomicLoad(&m_Chunks);
+	for (;;) {
+		chunk->m_Next = head;
+		PoolChunk* prev = (PoolChunk*)atomicCompareAndSwapPtr(&m_Chunks, (void*)head, (void*)chunk);
+		if (prev == head) {
+			break;
+		}
+		head = prev;
+	}
+
+	const uint32_t blockSize = kHeaderSize + s_ClassSizes[sizeClass];
+	const uint32_t numBlocks = (m_ChunkSize - (uint32_t)sizeof(PoolChunk)) / blockSize;
+
+	uint8_t* mem = (uint8_t*)(chunk + 1);
+	PoolBlock* first = nullptr;
+	uint32_t firstCount = 0;
+	for (uint32_t i = 0; i < numBlocks; i += kBatchSize) {
+		// Not bx::min(), which would take kBatchSize by reference (and require a definition).
+		const uint32_t batchSize = numBlocks - i < kBatchSize ? numBlocks - i : kBatchSize;
+
+		PoolBlock* batch = (PoolBlock*)(mem + i * blockSize);
+		for (uint32_t j = 0; j < batchSize; ++j) {
+			PoolBlock* block = (PoolBlock*)(mem + (i + j) * blockSize);
+			block->m_SizeClass = sizeClass;
+			block->m_Next = j + 1 < batchSize ? (PoolBlock*)((uint8_t*)block + blockSize) : nullptr;
+		}
+
+		if (!first) {
+			first = batch;
+			firstCount = batchSize;
+		} else {
+			pushBatch(sizeClass, batch, batchSize);
+		}
+	}
+
+	count = firstCount;
+	return first;
+}
+
+void pool_allocator::pushBatch(uint32_t sizeClass, PoolBlock* batch, uint32_t count)
+{
+	batch->m_Offset = count;
+
+	uint64_t* stack = &m_FreeBatches[sizeClass];
+	uint64_t head = atomicLoad(stack);
+	for (;;) {
+		batch->m_NextBatch = unpackTagged(head);
+		const uint64_t newHead = packTagged(batch, (head >> 48) + 1);
+		const uint64_t prev = bx::atomicCompareAndSwap<uint64_t>(stack, head, newHead);
+		if (prev == head) {
+			break;
+		}
+		head = prev;
+	}
+}
+
+PoolBlock* pool_allocator::popBatch(uint32_t sizeClass, uint32_t& count)
+{
+	uint64_t* stack = &m_FreeBatches[sizeClass];
+	uint64_t head = atomicLoad(stack);
+	for (;;) {
+		PoolBlock* batch = unpackTagged(head);
+		if (!batch) {
+			return nullptr;
+		}
+
+		const uint64_t newHead = packTagged(batch->m_NextBatch, (head >> 48) + 1);
+		const uint64_t prev = bx::atomicCompareAndSwap<uint64_t>(stack, head, newHead);
+		if (prev == head) {
+			count = batch->m_Offset;
+			return batch;
+		}
+		head = prev;
+	}
+}
+
+PoolThreadCache* pool_allocator::getThreadCache()
+{
+	PoolThreadCache* cache = &s_ThreadCaches[m_Slot];
+	if (cache->m_Generation != m_Generation) {
+		bx::memSet(cache, 0, sizeof(PoolThreadCache));
+		cache->m_Generation = m_Generation;
+
+		// Accessing the owner constructs it and registers its destructor for this thread.
+		s_ThreadCacheOwner.m_Registered = true;
+	}
+
+	return cache;
+}
+
+bx::AllocatorI* getPoolAllocator()
+{
+	// Never destroyed, so it can be used from other static destructors. The initialization
+	// of the local static is thread safe.
+	static uint64_t buffer[(sizeof(pool_allocator) + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+	static pool_allocator* poolAllocator = BX_PLACEMENT_NEW(buffer, pool_allocator)(getDefaultAllocator());
+	return poolAllocator;
+}
+}
@@ -0,0 +1,573 @@
+#include <stdint.h>
+#include <bx/allocator.h>
+#include <bx/cpu.h>
+#include "../include/jtl/rope.h"
+
+namespace jtl
+{
+// Leaves are split to at most this many characters when created from a flat buffer.
+static const uint32_t kMaxLeafLength = 4096;
+
+// Adjacent leaves which together are at most this long are merged into a new leaf
+// instead of creating a concatenation node for them.
+static const uint32_t kMaxMergeLength = 256;
+
+// Slices shorter than this are copied into a new leaf instead of referencing the
+// original leaf.
+static const uint32_t kMinSliceLength = 32;
+
+struct RopeNode
+{
+	enum Type : uint8_t
+	{
+		Leaf,   // Characters follow the node
+		Slice,  // [m_Offset, m_Offset + m_Length) of the leaf m_Left
+		Concat, // m_Left followed by m_Right
+	};
+
+	bx::AllocatorI* m_Allocator;
+	RopeNode* m_Left;
+	RopeNode* m_Right;
+	int32_t m_RefCount;
+	uint32_t m_Length;
+	uint32_t m_Offset;
+	uint8_t m_Type;
+	uint8_t m_Height; // 0 for leaves and slices
+
+	const char* getChars() const
+	{
+		return m_Type == Leaf
+			? (const char*)(this + 1)
+			: (const char*)(m_Left + 1) + m_Offset
+			;
+	}
+};
+
+typedef RopeNode Node;
+
+static inline Node* addRef(Node* node)
+{
+	if (node) {
+		bx::atomicAddAndFetch(&node->m_RefCount, 1);
+	}
+
+	return node;
+}
+
+static void release(Node* node)
+{
+	while (node) {
+		JTL_CHECK(node->m_RefCount > 0, "Invalid reference count");
+		if (bx::atomicSubAndFetch(&node->m_RefCount, 1) != 0) {
+			return;
+		}
+
+		// Release the left subtree recursively (its height is bounded by the tree height)
+		// and iterate on the right one.
+		Node* next = nullptr;
+		if (node->m_Type == Node::Concat) {
+			release(node->m_Left);
+			next = node->m_Right;
+		} else if (node->m_Type == Node::Slice) {
+			next = node->m_Left;
+		}
+
+		BX_FREE(node->m_Allocator, node);
+		node = next;
+	}
+}
+
+static inline uint32_t height(const Node* node)
+{
+	return node ? node->m_Height : 0;
+}
+
+static inline uint32_t length(const Node* node)
+{
+	return node ? node->m_Length : 0;
+}
+
+static Node* allocNode(bx::AllocatorI* allocator, uint8_t type, uint32_t extraSize)
+{
+	Node* node = (Node*)BX_ALLOC(allocator, sizeof(Node) + extraSize);
+	JTL_CHECK(node, "Allocation failed");
+	node->m_Allocator = allocator;
+	node->m_Left = nullptr;
+	node->m_Right = nullptr;
+	node->m_RefCount = 1;
+	node->m_Length = 0;
+	node->m_Offset = 0;
+	node->m_Type = type;
+	node->m_Height = 0;
+	return node;
+}
+
+static Node* makeLeaf(bx::AllocatorI* allocator, const char* str, uint32_t len)
+{
+	Node* node = allocNode(allocator, Node::Leaf, len);
+	node->m_Length = len;
+	bx::memCopy(node + 1, str, len);
+	return node;
+}
+
+static Node* makeLeaf(bx::AllocatorI* allocator, const Node* a, const Node* b)
+{
+	const uint32_t lenA = a->m_Length;
+	const uint32_t lenB = b->m_Length;
+	Node* node = allocNode(allocator, Node::Leaf, lenA + lenB);
+	node->m_Length = lenA + lenB;
+	bx::memCopy(node + 1, a->getChars(), lenA);
+	bx::memCopy((char*)(node + 1) + lenA, b->getChars(), lenB);
+	return node;
+}
+
+// Borrows src (a leaf or a slice), returns a new reference.
+static Node* makeSlice(bx::AllocatorI* allocator, Node* src, uint32_t offset, uint32_t len)
+{
+	JTL_CHECK(src->m_Type != Node::Concat, "Only leaves can be sliced");
+	JTL_CHECK(offset + len <= src->m_Length, "Invalid slice");
+
+	if (len == src->m_Length) {
+		return addRef(src);
+	}
+
+	if (len < kMinSliceLength) {
+		return makeLeaf(allocator, src->getChars() + offset, len);
+	}
+
+	Node* leaf = src;
+	if (src->m_Type == Node::Slice) {
+		leaf = src->m_Left;
+		offset += src->m_Offset;
+	}
+
+	Node* node = allocNode(allocator, Node::Slice, 0);
+	node->m_Left = addRef(leaf);
+	node->m_Offset = offset;
+	node->m_Length = len;
+	return node;
+}
+
+// Borrows left and right, returns a new reference. Doesn't rebalance.
+static Node* makeConcat(bx::AllocatorI* allocator, Node* left, Node* right)
+{
+	Node* node = allocNode(allocator, Node::Concat, 0);
+	node->m_Left = addRef(left);
+	node->m_Right = addRef(right);
+	node->m_Length = left->m_Length + right->m_Length;
+	const uint32_t h = bx::max<uint32_t>(left->m_Height, right->m_Height) + 1;
+	node->m_Height = (uint8_t)h;
+	return node;
+}
+
+// (a, (b, c)) -> ((a, b), c). Consumes node, returns a new reference.
+static Node* rotateLeft(bx::AllocatorI* allocator, Node* node)
+{
+	Node* right = node->m_Right;
+	Node* left = makeConcat(allocator, node->m_Left, right->m_Left);
+	Node* res = makeConcat(allocator, left, right->m_Right);
+	release(left);
+	release(node);
+	return res;
+}
+
+// ((a, b), c) -> (a, (b, c)). Consumes node, returns a new reference.
+static Node* rotateRight(bx::AllocatorI* allocator, Node* node)
+{
+	Node* left = node->m_Left;
+	Node* right = makeConcat(allocator, left->m_Right, node->m_Right);
+	Node* res = makeConcat(allocator, left->m_Left, right);
+	release(right);
+	release(node);
+	return res;
+}
+
+// Join algorithm for AVL trees from "Just Join for Parallel Ordered Sets" (Blelloch et al., 2016).
+// Both borrow their arguments and return a new reference.
+static Node* joinRight(bx::AllocatorI* allocator, Node* left, Node* right)
+{
+	// height(left) > height(right) + 1, so left is a concatenation.
+	Node* l = left->m_Left;
+	Node* c = left->m_Right;
+	if (height(c) <= height(right) + 1) {
+		Node* t = makeConcat(allocator, c, right);
+		if (height(t) <= height(l) + 1) {
+			Node* res = makeConcat(allocator, l, t);
+			release(t);
+			return res;
+		}
+
+		t = rotateRight(allocator, t);
+		Node* res = makeConcat(allocator, l, t);
+		release(t);
+		return rotateLeft(allocator, res);
+	}
+
+	Node* t = joinRight(allocator, c, right);
+	Node* res = makeConcat(allocator, l, t);
+	const bool balanced = height(t) <= height(l) + 1;
+	release(t);
+	return balanced ? res : rotateLeft(allocator, res);
+}
+
+static Node* joinLeft(bx::AllocatorI* allocator, Node* left, Node* right)
+{
+	// height(right) > height(left) + 1, so right is a concatenation.
+	Node* c = right->m_Left;
+	Node* r = right->m_Right;
+	if (height(c) <= height(left) + 1) {
+		Node* t = makeConcat(allocator, left, c);
+		if (height(t) <= height(r) + 1) {
+			Node* res = makeConcat(allocator, t, r);
+			release(t);
+			return res;
+		}
+
+		t = rotateLeft(allocator, t);
+		Node* res = makeConcat(allocator, t, r);
+		release(t);
+		return rotateRight(allocator, res);
+	}
+
+	Node* t = joinLeft(allocator, left, c);
+	Node* res = makeConcat(allocator, t, r);
+	const bool balanced = height(t) <= height(r) + 1;
+	release(t);
+	return balanced ? res : rotateRight(allocator, res);
+}
+
+static inline bool isFlat(const Node* node)
+{
+	return node->m_Type != Node::Concat;
+}
+
+static Node* join(bx::AllocatorI* allocator, Node* left, Node* right);
+
+// Replaces the last leaf of node with a new leaf containing it followed by right. Returns
+// nullptr if the combined leaf would be longer than kMaxMergeLength.
+static Node* mergeLast(bx::AllocatorI* allocator, Node* node, Node* right)
+{
+	if (isFlat(node)) {
+		return node->m_Length + right->m_Length <= kMaxMergeLength
+			? makeLeaf(allocator, node, right)
+			: nullptr
+			;
+	}
+
+	Node* last = mergeLast(allocator, node->m_Right, right);
+	if (!last) {
+		return nullptr;
+	}
+
+	Node* res = join(allocator, node->m_Left, last);
+	release(last);
+	return res;
+}
+
+static Node* join(bx::AllocatorI* allocator, Node* left, Node* right)
+{
+	if (!left || !left->m_Length) {
+		return addRef(right);
+	} else if (!right || !right->m_Length) {
+		return addRef(left);
+	}
+
+	// Typical case of appending small pieces one after the other: merge right with the
+	// last leaf of left.
+	if (isFlat(right) && right->m_Length < kMaxMergeLength) {
+		Node* res = mergeLast(allocator, left, right);
+		if (res) {
+			return res;
+		}
+	}
+
+	const uint32_t hl = height(left);
+	const uint32_t hr = height(right);
+	if (hl > hr + 1) {
+		return joinRight(allocator, left, right);
+	} else if (hr > hl + 1) {
+		return joinLeft(allocator, left, right);
+	}
+
+	return makeConcat(allocator, left, right);
+}
+
+// Borrows node, returns new references to the [0, pos) and [pos, length) parts.
+static void split(bx::AllocatorI* allocator, Node* node, uint32_t pos, Node** left, Node** right)
+{
+	if (pos == 0) {
+		*left = nullptr;
+		*right = addRef(node);
+		return;
+	} else if (pos >= node->m_Length) {
+		*left = addRef(node);
+		*right = nullptr;
+		return;
+	}
+
+	if (isFlat(node)) {
+		*left = makeSlice(allocator, node, 0, pos);
+		*right = makeSlice(allocator, node, pos, node->m_Length - pos);
+		return;
+	}
+
+	const uint32_t leftLength = node->m_Left->m_Length;
+	if (pos < leftLength) {
+		Node* a;
+		Node* b;
+		split(allocator, node->m_Left, pos, &a, &b);
+		*left = a;
+		*right = join(allocator, b, node->m_Right);
+		release(b);
+	} else if (pos == leftLength) {
+		*left = addRef(node->m_Left);
+		*right = addRef(node->m_Right);
+	} else {
+		Node* a;
+		Node* b;
+		split(allocator, node->m_Right, pos - leftLength, &a, &b);
+		*left = join(allocator, node->m_Left, a);
+		*right = b;
+		release(a);
+	}
+}
+
+// Builds a balanced tree out of a flat buffer, splitting it into leaves of at most
+// kMaxLeafLength characters.
+static Node* build(bx::AllocatorI* allocator, const char* str, uint32_t len)
+{
+	if (!len) {
+		return nullptr;
+	}
+
+	if (len <= kMaxLeafLength) {
+		return makeLeaf(allocator, str, len);
+	}
+
+	const uint32_t numLeaves = (len + kMaxLeafLength - 1) / kMaxLeafLength;
+	const uint32_t leftLength = (numLeaves / 2) * kMaxLeafLength;
+	Node* left = build(allocator, str, leftLength);
+	Node* right = build(allocator, str + leftLength, len - leftLength);
+	Node* res = makeConcat(allocator, left, right);
+	release(left);
+	release(right);
+	return res;
+}
+
+typedef void (*ChunkCallback)(void* userData, const bx::StringView& chunk);
+
+static void forEachChunk(const Node* node, uint32_t first, uint32_t last, ChunkCallback callback, void* userData)
+{
+	while (node && first < last) {
+		if (isFlat(node)) {
+			const char* chars = node->getChars();
+			callback(userData, bx::StringView(&chars[first], (int32_t)(last - first)));
+			return;
+		}
+
+		const uint32_t leftLength = node->m_Left->m_Length;
+		if (first < leftLength) {
+			forEachChunk(node->m_Left, first, bx::min(last, leftLength), callback, userData);
+		}
+
+		if (last <= leftLength) {
+			return;
+		}
+
+		first = first > leftLength ? first - leftLength : 0;
+		last -= leftLength;
+		node = node->m_Right;
+	}
+}
+
+static void copyChunk(void* userData, const bx::StringView& chunk)
+{
+	char** dst = (char**)userData;
+	bx::memCopy(*dst, chunk.getPtr(), chunk.getLength());
+	*dst += chunk.getLength();
+}
+
+rope::rope(const char* str, bx::AllocatorI* allocator)
+	: m_Root(nullptr)
+	, m_Allocator(allocator ? allocator : getDefaultAllocator())
+{
+	m_Root = build(m_Allocator, str, bx::strLen(str));
+}
+
+rope::rope(const char* str, uint32_t len, bx::AllocatorI* allocator)
+	: m_Root(nullptr)
+	, m_Allocator(allocator ? allocator : getDefaultAllocator())
+{
+	m_Root = build(m_Allocator, str, len);
+}
+
+rope::rope(const string& str, bx::AllocatorI* allocator)
+	: m_Root(nullptr)
+	, m_Allocator(allocator ? allocator : getDefaultAllocator())
+{
+	m_Root = build(m_Allocator, str.c_str(), str.size());
+}
+
+rope::rope(const rope& other)
+	: m_Root(addRef(other.m_Root))
+	, m_Allocator(other.m_Allocator)
+{
+}
+
+rope::~rope()
+{
+	release(m_Root);
+}
+
+rope& rope::operator = (const rope& other)
+{
+	if (&other != this) {
+		rope(other).swap(*this);
+	}
+
+	return *this;
+}
+
+uint32_t rope::size() const
+{
+	return length(m_Root);
+}
+
+char rope::operator [] (uint32_t index) const
+{
+	JTL_CHECK(index < size(), "Invalid index");
+
+	const Node* node = m_Root;
+	while (!isFlat(node)) {
+		const uint32_t leftLength = node->m_Left->m_Length;
+		if (index < leftLength) {
+			node = node->m_Left;
+		} else {
+			index -= leftLength;
+			node = node->m_Right;
+		}
+	}
+
+	return node->getChars()[index];
+}
+
+void rope::append(const char* str, uint32_t len)
+{
+	Node* leaf = build(m_Allocator, str, len);
+	Node* root = join(m_Allocator, m_Root, leaf);
+	release(leaf);
+	release(m_Root);
+	m_Root = root;
+}
+
+void rope::append(const rope& other)
+{
+	Node* root = join(m_Allocator, m_Root, other.m_Root);
+	release(m_Root);
+	m_Root = root;
+}
+
+void rope::insert(uint32_t pos, const char* str, uint32_t len)
+{
+	JTL_CHECK(pos <= size(), "Invalid index");
+
+	rope other(build(m_Allocator, str, len), m_Allocator);
+	insert(pos, other);
+}
+
+void rope::insert(uint32_t pos, const rope& other)
+{
+	JTL_CHECK(pos <= size(), "Invalid index");
+
+	if (!m_Root) {
+		*this = other;
+		return;
+	}
+
+	Node* left;
+	Node* right;
+	split(m_Allocator, m_Root, pos, &left, &right);
+
+	Node* leftMiddle = join(m_Allocator, left, other.m_Root);
+	Node* root = join(m_Allocator, leftMiddle, right);
+	release(leftMiddle);
+	release(left);
+	release(right);
+
+	release(m_Root);
+	m_Root = root;
+}
+
+void rope::erase(uint32_t first, uint32_t last)
+{
+	JTL_CHECK(first < size(), "Invalid index (first)");
+	JTL_CHECK(last <= size(), "Invalid index (last)");
+	JTL_CHECK(first < last, "Invalid index order (first >= last)");
+
+	Node* left;
+	Node* middle;
+	Node* right;
+	split(m_Allocator, m_Root, last, &middle, &right);
+	Node* tmp = middle;
+	split(m_Allocator, tmp, first, &left, &middle);
+	release(tmp);
+
+	Node* root = join(m_Allocator, left, right);
+	release(left);
+	release(middle);
+	release(right);
+
+	release(m_Root);
+	m_Root = root;
+}
+
+void rope::clear()
+{
+	release(m_Root);
+	m_Root = nullptr;
+}
+
+rope rope::substr(uint32_t first, uint32_t last) const
+{
+	JTL_CHECK(first < size(), "Invalid index (first)");
+	JTL_CHECK(last <= size(), "Invalid index (last)");
+	JTL_CHECK(first < last, "Invalid index order (first >= last)");
+
+	Node* left;
+	Node* middle;
+	Node* right;
+	split(m_Allocator, m_Root, last, &middle, &right);
+	release(right);
+	Node* tmp = middle;
+	split(m_Allocator, tmp, first, &left, &middle);
+	release(tmp);
+	release(left);
+
+	return rope(middle, m_Allocator);
+}
+
+void rope::copy(char* dst, uint32_t first, uint32_t last) const
+{
+	JTL_CHECK(first <= last && last <= size(), "Invalid range");
+	jtl::forEachChunk(m_Root, first, last, copyChunk, &dst);
+}
+
+string rope::flatten() const
+{
+	const uint32_t len = size();
+
+	string str(m_Allocator);
+	str.resize(len);
+	if (len) {
+		copy(&str[0], 0, len);
+	}
+
+	return str;
+}
+
+void rope::forEachChunk(uint32_t first, uint32_t last, ChunkCallback callback, void* userData) const
+{
+	JTL_CHECK(first <= last && last <= size(), "Invalid range");
+	jtl::forEachChunk(m_Root, first, last, callback, userData);
+}
+}
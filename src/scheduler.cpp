@@ -0,0 +1,319 @@
+#include <stdint.h>
+#include <bx/bx.h>
+#include <bx/allocator.h>
+#include <bx/cpu.h>
+#include "../include/jtl/scheduler.h"
+#include "../include/jtl/pool_allocator.h"
+#include "../include/jtl/atomic.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace jtl
+{
+static const uint32_t kSpinCount = 64;
+
+// Bounded Chase-Lev deque. Only the owner pushes and pops at the bottom; any thread can
+// steal from the top.
+struct SchedulerDeque
+{
+	int64_t m_Top;
+	uint8_t m_Padding[BX_CACHE_LINE_SIZE - sizeof(int64_t)];
+	int64_t m_Bottom;
+	scheduler_task* m_Tasks[scheduler::kDequeCapacity];
+
+	bool push(scheduler_task* task)
+	{
+		const int64_t bottom = m_Bottom;
+		const int64_t top = atomicLoad(&m_Top);
+		if (bottom - top >= (int64_t)scheduler::kDequeCapacity) {
+			return false;
+		}
+
+		atomicStore(&m_Tasks[bottom & (scheduler::kDequeCapacity - 1)], task);
+		atomicStore(&m_Bottom, bottom + 1);
+		return true;
+	}
+
+	scheduler_task* pop()
+	{
+		const int64_t bottom = m_Bottom - 1;
+		atomicStore(&m_Bottom, bottom);
+
+		// The new bottom must be visible before top is read, otherwise a thief and the
+		// owner could both take the last task.
+		bx::memoryBarrier();
+
+		int64_t top = atomicLoad(&m_Top);
+		if (top > bottom) {
+			atomicStore(&m_Bottom, bottom + 1);
+			return nullptr;
+		}
+
+		scheduler_task* task = atomicLoad(&m_Tasks[bottom & (scheduler::kDequeCapacity - 1)]);
+		if (top == bottom) {
+			// Last task; race against thieves for it.
+			if (bx::atomicCompareAndSwap<int64_t>(&m_Top, top, top + 1) != top) {
+				task = nullptr;
+			}
+			atomicStore(&m_Bottom, bottom + 1);
+		}
+
+		return task;
+	}
+
+	scheduler_task* steal()
+	{
+		const int64_t top = atomicLoad(&m_Top);
+		bx::memoryBarrier();
+		const int64_t bottom = atomicLoad(&m_Bottom);
+		if (top >= bottom) {
+			return nullptr;
+		}
+
+		scheduler_task* task = atomicLoad(&m_Tasks[top & (scheduler::kDequeCapacity - 1)]);
+		if (bx::atomicCompareAndSwap<int64_t>(&m_Top, top, top + 1) != top) {
+			return nullptr;
+		}
+
+		return task;
+	}
+};
+
+struct SchedulerWorker
+{
+	SchedulerDeque m_Deque;
+	scheduler* m_Scheduler;
+	std::thread m_Thread;
+	uint32_t m_Index;
+	uint32_t m_Random;
+};
+
+struct SchedulerState
+{
+	std::mutex m_InjectMutex;
+	scheduler_task* m_InjectHead;
+	scheduler_task* m_InjectTail;
+
+	std::mutex m_SleepMutex;
+	std::condition_variable m_CondVar;
+
+	int32_t m_NumPending; // Submitted tasks which haven't been picked up yet
+	int32_t m_NumSleeping;
+	bool m_Stop;
+};
+
+static thread_local SchedulerWorker* s_CurrentWorker = nullptr;
+
+static inline uint32_t nextRandom(uint32_t& state)
+{
+	// xorshift32
+	uint32_t x = state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	state = x;
+	return x;
+}
+
+scheduler::scheduler(uint32_t numWorkers, bx::AllocatorI* allocator)
+	: m_Allocator(allocator ? allocator : getDefaultAllocator())
+	, m_State(nullptr)
+	, m_Workers(nullptr)
+	, m_NumWorkers(numWorkers)
+{
+	if (!m_NumWorkers) {
+		const uint32_t hardwareThreads = std::thread::hardware_concurrency();
+		m_NumWorkers = hardwareThreads ? hardwareThreads : 1;
+	}
+
+	m_State = BX_NEW(m_Allocator, SchedulerState);
+	m_State->m_InjectHead = nullptr;
+	m_State->m_InjectTail = nullptr;
+	m_State->m_NumPending = 0;
+	m_State->m_NumSleeping = 0;
+	m_State->m_Stop = false;
+
+	m_Workers = (SchedulerWorker*)BX_ALIGNED_ALLOC(m_Allocator, sizeof(SchedulerWorker) * m_NumWorkers, BX_CACHE_LINE_SIZE);
+	JTL_CHECK(m_Workers, "Allocation failed");
+	for (uint32_t i = 0; i < m_NumWorkers; ++i) {
+		SchedulerWorker* worker = BX_PLACEMENT_NEW(&m_Workers[i], SchedulerWorker)();
+		worker->m_Deque.m_Top = 0;
+		worker->m_Deque.m_Bottom = 0;
+		worker->m_Scheduler = this;
+		worker->m_Index = i;
+		worker->m_Random = 0x9e3779b9u * (i + 1);
+	}
+
+	// Start the threads only after all the workers are initialized, since they steal
+	// from each other.
+	for (uint32_t i = 0; i < m_NumWorkers; ++i) {
+		SchedulerWorker* worker = &m_Workers[i];
+		worker->m_Thread = std::thread([this, worker]() {
+			workerMain(worker);
+		});
+	}
+}
+
+scheduler::~scheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_State->m_SleepMutex);
+		m_State->m_Stop = true;
+	}
+	m_State->m_CondVar.notify_all();
+
+	for (uint32_t i = 0; i < m_NumWorkers; ++i) {
+		m_Workers[i].m_Thread.join();
+		m_Workers[i].~SchedulerWorker();
+	}
+
+	BX_ALIGNED_FREE(m_Allocator, m_Workers, BX_CACHE_LINE_SIZE);
+	BX_DELETE(m_Allocator, m_State);
+}
+
+void scheduler::submit(scheduler_task* task)
+{
+	// Count the task before publishing it so that a worker which takes it can't bring the
+	// counter below 0.
+	bx::atomicFetchAndAdd<int32_t>(&m_State->m_NumPending, 1);
+
+	SchedulerWorker* worker = s_CurrentWorker;
+	if (!worker || worker->m_Scheduler != this || !worker->m_Deque.push(task)) {
+		task->m_Next = nullptr;
+
+		std::lock_guard<std::mutex> lock(m_State->m_InjectMutex);
+		if (m_State->m_InjectTail) {
+			m_State->m_InjectTail->m_Next = task;
+		} else {
+			// Workers peek at the head without the lock.
+			atomicStore(&m_State->m_InjectHead, task);
+		}
+		m_State->m_InjectTail = task;
+	}
+
+	wakeWorker();
+}
+
+bool scheduler::tryRunOne()
+{
+	SchedulerWorker* worker = s_CurrentWorker;
+	scheduler_task* task = findTask(worker && worker->m_Scheduler == this ? worker : nullptr);
+	if (!task) {
+		return false;
+	}
+
+	task->m_Execute(task);
+	return true;
+}
+
+bool scheduler::isWorkerThread() const
+{
+	return s_CurrentWorker && s_CurrentWorker->m_Scheduler == this;
+}
+
+// Looks for a task in the worker's own deque (if any), the injection queue and the
+// other workers' deques, in that order.
+scheduler_task* scheduler::findTask(SchedulerWorker* worker)
+{
+	SchedulerState* state = m_State;
+	if (!atomicLoad(&state->m_NumPending)) {
+		return nullptr;
+	}
+
+	scheduler_task* task = worker ? worker->m_Deque.pop() : nullptr;
+
+	if (!task && atomicLoad(&state->m_InjectHead)) {
+		std::lock_guard<std::mutex> lock(state->m_InjectMutex);
+		task = state->m_InjectHead;
+		if (task) {
+			atomicStore(&state->m_InjectHead, task->m_Next);
+			if (!task->m_Next) {
+				state->m_InjectTail = nullptr;
+			}
+		}
+	}
+
+	if (!task) {
+		const uint32_t start = worker ? nextRandom(worker->m_Random) % m_NumWorkers : 0;
+		for (uint32_t i = 0; i < m_NumWorkers && !task; ++i) {
+			SchedulerWorker* victim = &m_Workers[(start + i) % m_NumWorkers];
+			if (victim != worker) {
+				task = victim->m_Deque.steal();
+			}
+		}
+	}
+
+	if (task) {
+		bx::atomicFetchAndSub<int32_t>(&state->m_NumPending, 1);
+	}
+
+	return task;
+}
+
+void scheduler::workerMain(SchedulerWorker* worker)
+{
+	s_CurrentWorker = worker;
+
+	SchedulerState* state = m_State;
+	uint32_t numSpins = 0;
+	for (;;) {
+		scheduler_task* task = findTask(worker);
+		if (task) {
+			task->m_Execute(task);
+			numSpins = 0;
+			continue;
+		}
+
+		if (++numSpins < kSpinCount) {
+			std::this_thread::yield();
+			continue;
+		}
+		numSpins = 0;
+
+		// The sleeping counter is incremented before checking for pending tasks, and
+		// submit() increments the pending counter before checking for sleepers, so at
+		// least one side sees the other.
+		std::unique_lock<std::mutex> lock(state->m_SleepMutex);
+		bx::atomicFetchAndAdd<int32_t>(&state->m_NumSleeping, 1);
+		bx::memoryBarrier();
+		while (!atomicLoad(&state->m_NumPending) && !state->m_Stop) {
+			state->m_CondVar.wait(lock);
+		}
+		bx::atomicFetchAndSub<int32_t>(&state->m_NumSleeping, 1);
+
+		// Pending tasks are drained before stopping.
+		if (state->m_Stop && !atomicLoad(&state->m_NumPending)) {
+			break;
+		}
+	}
+
+	s_CurrentWorker = nullptr;
+}
+
+void scheduler::wakeWorker()
+{
+	SchedulerState* state = m_State;
+	bx::memoryBarrier();
+	if (atomicLoad(&state->m_NumSleeping) > 0) {
+		std::lock_guard<std::mutex> lock(state->m_SleepMutex);
+		state->m_CondVar.notify_one();
+	}
+}
+
+scheduler* getCurrentScheduler()
+{
+	SchedulerWorker* worker = s_CurrentWorker;
+	return worker ? worker->m_Scheduler : nullptr;
+}
+
+scheduler* getDefaultScheduler()
+{
+	// Never destroyed, so tasks can still be scheduled from other static destructors. The
+	// initialization of the local static is thread safe.
+	static uint64_t buffer[(sizeof(scheduler) + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+	static scheduler* sched = BX_PLACEMENT_NEW(buffer, scheduler)(0, getPoolAllocator());
+	return sched;
+}
+}
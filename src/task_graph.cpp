@@ -0,0 +1,370 @@
+#include <stdint.h>
+#include <bx/bx.h>
+#include <bx/allocator.h>
+#include <bx/cpu.h>
+#include "../include/jtl/task_graph.h"
+#include "../include/jtl/atomic.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace jtl
+{
+static const uint32_t kMaxChunks = 256;
+static const uint32_t kChunksPerWorker = 4;
+
+struct TaskGraphNode : public scheduler_task
+{
+	task_graph* m_Graph;
+	task_graph::function_type m_Func;
+	uint32_t m_FirstSuccessor;
+	uint32_t m_NumSuccessors;
+	uint32_t m_NumDependencies;
+	int32_t m_Pending; // Dependencies which haven't completed yet in the current run
+};
+
+struct TaskGraphSignal
+{
+	std::mutex m_Mutex;
+	std::condition_variable m_CondVar;
+	bool m_Done;
+};
+
+struct ParallelForContext
+{
+	void (*m_Func)(void* userData, uint32_t first, uint32_t last);
+	void* m_UserData;
+	int32_t m_Remaining;
+};
+
+struct ParallelForChunk : public scheduler_task
+{
+	ParallelForContext* m_Context;
+	uint32_t m_First;
+	uint32_t m_Last;
+};
+
+task_graph::task_graph(scheduler* sched, bx::AllocatorI* allocator)
+	: m_Scheduler(sched ? sched : getDefaultScheduler())
+	, m_Allocator(allocator ? allocator : getDefaultAllocator())
+	, m_Nodes(nullptr)
+	, m_Signal(nullptr)
+	, m_Successors(nullptr)
+	, m_NumNodes(0)
+	, m_Capacity(0)
+	, m_NumSuccessors(0)
+	, m_Remaining(0)
+	, m_Dirty(false)
+{
+	m_Signal = BX_NEW(m_Allocator, TaskGraphSignal);
+	m_Signal->m_Done = true;
+}
+
+task_graph::~task_graph()
+{
+	// The last node of a run might still be signaling completion.
+	wait();
+	clear();
+	BX_FREE(m_Allocator, m_Nodes);
+	BX_DELETE(m_Allocator, m_Signal);
+}
+
+void task_graph::reserve(uint32_t numTasks)
+{
+	JTL_CHECK(is_done(), "Modifying a running task graph");
+	if (numTasks <= m_Capacity) {
+		return;
+	}
+
+	TaskGraphNode* nodes = (TaskGraphNode*)BX_ALLOC(m_Allocator, sizeof(TaskGraphNode) * numTasks);
+	JTL_CHECK(nodes, "Allocation failed");
+	for (uint32_t i = 0; i < m_NumNodes; ++i) {
+		BX_PLACEMENT_NEW(&nodes[i], TaskGraphNode)(std::move(m_Nodes[i]));
+		m_Nodes[i].~TaskGraphNode();
+	}
+
+	BX_FREE(m_Allocator, m_Nodes);
+	m_Nodes = nodes;
+	m_Capacity = numTasks;
+}
+
+task_graph::task_id task_graph::add(function_type&& func)
+{
+	if (m_NumNodes == m_Capacity) {
+		reserve(m_Capacity ? m_Capacity * 2 : 16);
+	}
+
+	JTL_CHECK(is_done(), "Modifying a running task graph");
+	TaskGraphNode* node = BX_PLACEMENT_NEW(&m_Nodes[m_NumNodes], TaskGraphNode)();
+	node->m_Next = nullptr;
+	node->m_Execute = executeNode;
+	node->m_Graph = this;
+	node->m_Func = std::move(func);
+	node->m_FirstSuccessor = 0;
+	node->m_NumSuccessors = 0;
+	node->m_NumDependencies = 0;
+	node->m_Pending = 0;
+
+	m_Dirty = true;
+	return m_NumNodes++;
+}
+
+void task_graph::depend(task_id task, task_id dependency)
+{
+	JTL_CHECK(is_done(), "Modifying a running task graph");
+	JTL_CHECK(task < m_NumNodes && dependency < m_NumNodes && task != dependency, "Invalid task");
+	m_Edges.push_back(((uint64_t)dependency << 32) | task);
+	m_Dirty = true;
+}
+
+void task_graph::clear()
+{
+	JTL_CHECK(is_done(), "Modifying a running task graph");
+	wait();
+	for (uint32_t i = 0; i < m_NumNodes; ++i) {
+		m_Nodes[i].~TaskGraphNode();
+	}
+	m_NumNodes = 0;
+
+	m_Edges.clear();
+	BX_FREE(m_Allocator, m_Successors);
+	m_Successors = nullptr;
+	m_NumSuccessors = 0;
+	m_Dirty = false;
+}
+
+bool task_graph::start()
+{
+	JTL_CHECK(is_done(), "Task graph is already running");
+
+	// Make sure the last node of the previous run is done with the signal before it's
+	// reset (m_Remaining drops to 0 before the signal is set).
+	wait();
+
+	if (m_Dirty && !build()) {
+		return false;
+	}
+
+	if (!m_NumNodes) {
+		return true;
+	}
+
+	m_Signal->m_Done = false;
+	m_Remaining = (int32_t)m_NumNodes;
+	for (uint32_t i = 0; i < m_NumNodes; ++i) {
+		m_Nodes[i].m_Pending = (int32_t)m_Nodes[i].m_NumDependencies;
+	}
+
+	// Everything has to be reset before the first node is submitted.
+	bx::memoryBarrier();
+
+	for (uint32_t i = 0; i < m_NumNodes; ++i) {
+		if (!m_Nodes[i].m_NumDependencies) {
+			m_Scheduler->submit(&m_Nodes[i]);
+		}
+	}
+
+	return true;
+}
+
+void task_graph::wait()
+{
+	TaskGraphSignal* signal = m_Signal;
+	if (m_Scheduler->isWorkerThread()) {
+		while (atomicLoad(&m_Remaining) != 0) {
+			if (!m_Scheduler->tryRunOne()) {
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	// Also makes sure the last node is done with the signal before returning.
+	std::unique_lock<std::mutex> lock(signal->m_Mutex);
+	while (!signal->m_Done) {
+		signal->m_CondVar.wait(lock);
+	}
+}
+
+// Done once the last node has released the signal, not only when m_Remaining reaches 0,
+// so that the graph can be restarted or destroyed as soon as this returns true.
+bool task_graph::is_done() const
+{
+	std::lock_guard<std::mutex> lock(m_Signal->m_Mutex);
+	return m_Signal->m_Done;
+}
+
+bool task_graph::run()
+{
+	if (!start()) {
+		return false;
+	}
+
+	wait();
+	return true;
+}
+
+// Turns the edge list into per-node successor ranges (counting sort by dependency).
+// Returns false if the graph has a cycle.
+bool task_graph::build()
+{
+	for (uint32_t i = 0; i < m_NumNodes; ++i) {
+		m_Nodes[i].m_NumSuccessors = 0;
+		m_Nodes[i].m_NumDependencies = 0;
+	}
+
+	const uint32_t numEdges = m_Edges.size();
+	for (uint32_t i = 0; i < numEdges; ++i) {
+		const uint64_t edge = m_Edges[i];
+		m_Nodes[(uint32_t)(edge >> 32)].m_NumSuccessors++;
+		m_Nodes[(uint32_t)edge].m_NumDependencies++;
+	}
+
+	uint32_t first = 0;
+	for (uint32_t i = 0; i < m_NumNodes; ++i) {
+		m_Nodes[i].m_FirstSuccessor = first;
+		first += m_Nodes[i].m_NumSuccessors;
+		m_Nodes[i].m_NumSuccessors = 0;
+	}
+
+	if (numEdges > m_NumSuccessors) {
+		BX_FREE(m_Allocator, m_Successors);
+		m_Successors = (uint32_t*)BX_ALLOC(m_Allocator, sizeof(uint32_t) * numEdges);
+		JTL_CHECK(m_Successors, "Allocation failed");
+	}
+	m_NumSuccessors = numEdges;
+
+	for (uint32_t i = 0; i < numEdges; ++i) {
+		const uint64_t edge = m_Edges[i];
+		TaskGraphNode& node = m_Nodes[(uint32_t)(edge >> 32)];
+		m_Successors[node.m_FirstSuccessor + node.m_NumSuccessors++] = (uint32_t)edge;
+	}
+
+	if (!isAcyclic()) {
+		JTL_CHECK(false, "Task graph has a cycle");
+		return false;
+	}
+
+	m_Dirty = false;
+	return true;
+}
+
+// Kahn's algorithm: the graph is acyclic iff every node can be reached by repeatedly
+// removing nodes without dependencies. Uses m_Pending as scratch (the graph isn't
+// running).
+bool task_graph::isAcyclic()
+{
+	if (!m_NumSuccessors) {
+		return true;
+	}
+
+	uint32_t* ready = (uint32_t*)BX_ALLOC(m_Allocator, sizeof(uint32_t) * m_NumNodes);
+	JTL_CHECK(ready, "Allocation failed");
+
+	uint32_t numReady = 0;
+	for (uint32_t i = 0; i < m_NumNodes; ++i) {
+		m_Nodes[i].m_Pending = (int32_t)m_Nodes[i].m_NumDependencies;
+		if (!m_Nodes[i].m_NumDependencies) {
+			ready[numReady++] = i;
+		}
+	}
+
+	uint32_t numVisited = 0;
+	while (numVisited < numReady) {
+		const TaskGraphNode& node = m_Nodes[ready[numVisited++]];
+		const uint32_t* successors = &m_Successors[node.m_FirstSuccessor];
+		for (uint32_t i = 0; i < node.m_NumSuccessors; ++i) {
+			if (--m_Nodes[successors[i]].m_Pending == 0) {
+				ready[numReady++] = successors[i];
+			}
+		}
+	}
+
+	BX_FREE(m_Allocator, ready);
+	return numVisited == m_NumNodes;
+}
+
+void task_graph::executeNode(scheduler_task* task)
+{
+	TaskGraphNode* node = static_cast<TaskGraphNode*>(task);
+	task_graph* graph = node->m_Graph;
+
+	node->m_Func();
+
+	const uint32_t* successors = &graph->m_Successors[node->m_FirstSuccessor];
+	const uint32_t numSuccessors = node->m_NumSuccessors;
+	for (uint32_t i = 0; i < numSuccessors; ++i) {
+		TaskGraphNode* successor = &graph->m_Nodes[successors[i]];
+		if (bx::atomicSubAndFetch<int32_t>(&successor->m_Pending, 1) == 0) {
+			graph->m_Scheduler->submit(successor);
+		}
+	}
+
+	// The signal is only touched by the last node, and wait() doesn't return before it
+	// has released the mutex.
+	TaskGraphSignal* signal = graph->m_Signal;
+	if (bx::atomicSubAndFetch<int32_t>(&graph->m_Remaining, 1) == 0) {
+		std::lock_guard<std::mutex> lock(signal->m_Mutex);
+		signal->m_Done = true;
+		signal->m_CondVar.notify_all();
+	}
+}
+
+static void executeChunk(scheduler_task* task)
+{
+	ParallelForChunk* chunk = static_cast<ParallelForChunk*>(task);
+	ParallelForContext* context = chunk->m_Context;
+	context->m_Func(context->m_UserData, chunk->m_First, chunk->m_Last);
+
+	// The chunks live on the stack of the calling thread; nothing can be accessed after
+	// this.
+	bx::atomicFetchAndSub<int32_t>(&context->m_Remaining, 1);
+}
+
+void parallelForRange(uint32_t begin, uint32_t end, uint32_t grainSize, void (*func)(void* userData, uint32_t first, uint32_t last), void* userData, scheduler* sched)
+{
+	if (begin >= end) {
+		return;
+	}
+
+	sched = sched ? sched : getDefaultScheduler();
+
+	const uint32_t count = end - begin;
+	if (!grainSize) {
+		const uint32_t numChunks = sched->getNumWorkers() * kChunksPerWorker;
+		grainSize = (count + numChunks - 1) / numChunks;
+	}
+	grainSize = bx::max<uint32_t>(bx::max<uint32_t>(grainSize, (count + kMaxChunks - 1) / kMaxChunks), 1);
+
+	const uint32_t numChunks = (count + grainSize - 1) / grainSize;
+	if (numChunks == 1) {
+		func(userData, begin, end);
+		return;
+	}
+
+	ParallelForContext context;
+	context.m_Func = func;
+	context.m_UserData = userData;
+	context.m_Remaining = (int32_t)numChunks - 1;
+
+	// The first chunk is run by the calling thread.
+	ParallelForChunk chunks[kMaxChunks];
+	for (uint32_t i = 1; i < numChunks; ++i) {
+		ParallelForChunk& chunk = chunks[i];
+		chunk.m_Next = nullptr;
+		chunk.m_Execute = executeChunk;
+		chunk.m_Context = &context;
+		chunk.m_First = begin + i * grainSize;
+		chunk.m_Last = bx::min<uint32_t>(chunk.m_First + grainSize, end);
+		sched->submit(&chunk);
+	}
+
+	func(userData, begin, begin + grainSize);
+
+	while (atomicLoad(&context.m_Remaining) != 0) {
+		if (!sched->tryRunOne()) {
+			std::this_thread::yield();
+		}
+	}
+}
+}
@@ -0,0 +1,329 @@
+#include <stdint.h>
+#include <bx/bx.h>
+#include <bx/allocator.h>
+#include "../include/jtl/timer_wheel.h"
+
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+
+namespace jtl
+{
+static const uint32_t kInvalidIndex = ~0u;
+
+struct TimerNode
+{
+	timer_wheel::callback_type m_Callback;
+	uint64_t m_Expiry;
+	uint32_t m_Prev;
+	uint32_t m_Next;
+	uint32_t m_List; // Slot list the node is linked into
+	uint32_t m_Generation; // Odd while the timer is scheduled
+};
+
+struct TimerDriver
+{
+	std::thread m_Thread;
+	std::mutex m_Mutex;
+	std::condition_variable m_CondVar;
+	bool m_Stop;
+};
+
+timer_wheel::timer_wheel(bx::AllocatorI* allocator)
+	: m_Allocator(allocator ? allocator : getDefaultAllocator())
+	, m_Nodes(nullptr)
+	, m_Driver(nullptr)
+	, m_Now(0)
+	, m_NumNodes(0)
+	, m_Capacity(0)
+	, m_FreeList(kInvalidIndex)
+	, m_NumTimers(0)
+{
+	for (uint32_t i = 0; i < BX_COUNTOF(m_Slots); ++i) {
+		m_Slots[i] = kInvalidIndex;
+	}
+}
+
+timer_wheel::~timer_wheel()
+{
+	stop();
+
+	for (uint32_t i = 0; i < m_NumNodes; ++i) {
+		m_Nodes[i].~TimerNode();
+	}
+	BX_FREE(m_Allocator, m_Nodes);
+}
+
+timer_handle timer_wheel::schedule(uint64_t delayTicks, callback_type&& callback)
+{
+	JTL_CHECK(callback, "Scheduling a null callback");
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	const uint32_t index = allocNode();
+	TimerNode& node = m_Nodes[index];
+	node.m_Callback = std::move(callback);
+	node.m_Expiry = m_Now + (delayTicks ? delayTicks : 1);
+	node.m_Generation++;
+	insert(index);
+	++m_NumTimers;
+
+	timer_handle handle;
+	handle.m_Index = index;
+	handle.m_Generation = node.m_Generation;
+	return handle;
+}
+
+bool timer_wheel::cancel(timer_handle handle)
+{
+	callback_type callback;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (!handle.isValid() || handle.m_Index >= m_NumNodes || m_Nodes[handle.m_Index].m_Generation != handle.m_Generation) {
+			return false;
+		}
+
+		unlink(handle.m_Index);
+
+		// Destroy the callback outside of the lock.
+		callback = std::move(m_Nodes[handle.m_Index].m_Callback);
+		freeNode(handle.m_Index);
+		--m_NumTimers;
+	}
+
+	return true;
+}
+
+uint32_t timer_wheel::advance(uint32_t numTicks)
+{
+	uint32_t numFired = 0;
+	for (uint32_t tick = 0; tick < numTicks; ++tick) {
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			++m_Now;
+
+			// Redistribute the next slot of every level whose lower levels have wrapped
+			// around, higher levels first so that their timers can cascade further down.
+			for (uint32_t level = kNumLevels - 1; level > 0; --level) {
+				const uint64_t mask = (1ull << (level * kSlotBits)) - 1;
+				if ((m_Now & mask) == 0) {
+					cascade(level);
+				}
+			}
+
+			// Move the expired timers to the firing list.
+			const uint32_t slot = (uint32_t)(m_Now & (kNumSlots - 1));
+			uint32_t index = m_Slots[slot];
+			m_Slots[slot] = kInvalidIndex;
+			while (index != kInvalidIndex) {
+				const uint32_t next = m_Nodes[index].m_Next;
+				link(index, kFiringList);
+				index = next;
+			}
+		}
+
+		numFired += fireExpired();
+	}
+
+	return numFired;
+}
+
+void timer_wheel::start(uint32_t tickMs)
+{
+	if (m_Driver) {
+		return;
+	}
+
+	TimerDriver* driver = BX_NEW(m_Allocator, TimerDriver);
+	driver->m_Stop = false;
+	driver->m_Thread = std::thread([this, driver, tickMs]() {
+		// Ticks are derived from the elapsed time so that slow callbacks don't make the
+		// wheel drift.
+		const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+		const std::chrono::milliseconds tickDuration(tickMs ? tickMs : 1);
+		uint64_t numTicks = 0;
+
+		std::unique_lock<std::mutex> lock(driver->m_Mutex);
+		while (!driver->m_Stop) {
+			driver->m_CondVar.wait_until(lock, startTime + tickDuration * (numTicks + 1));
+			if (driver->m_Stop) {
+				break;
+			}
+
+			const uint64_t elapsed = (uint64_t)((std::chrono::steady_clock::now() - startTime) / tickDuration);
+			if (elapsed > numTicks) {
+				lock.unlock();
+				advance((uint32_t)(elapsed - numTicks));
+				lock.lock();
+				numTicks = elapsed;
+			}
+		}
+	});
+
+	m_Driver = driver;
+}
+
+void timer_wheel::stop()
+{
+	TimerDriver* driver = m_Driver;
+	if (!driver) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(driver->m_Mutex);
+		driver->m_Stop = true;
+	}
+	driver->m_CondVar.notify_one();
+	driver->m_Thread.join();
+
+	BX_DELETE(m_Allocator, driver);
+	m_Driver = nullptr;
+}
+
+uint64_t timer_wheel::now() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Now;
+}
+
+uint32_t timer_wheel::size() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_NumTimers;
+}
+
+uint32_t timer_wheel::allocNode()
+{
+	if (m_FreeList != kInvalidIndex) {
+		const uint32_t index = m_FreeList;
+		m_FreeList = m_Nodes[index].m_Next;
+		return index;
+	}
+
+	if (m_NumNodes == m_Capacity) {
+		const uint32_t capacity = m_Capacity ? m_Capacity * 2 : 64;
+		TimerNode* nodes = (TimerNode*)BX_ALLOC(m_Allocator, sizeof(TimerNode) * capacity);
+		JTL_CHECK(nodes, "Allocation failed");
+		for (uint32_t i = 0; i < m_NumNodes; ++i) {
+			BX_PLACEMENT_NEW(&nodes[i], TimerNode)(std::move(m_Nodes[i]));
+			m_Nodes[i].~TimerNode();
+		}
+
+		BX_FREE(m_Allocator, m_Nodes);
+		m_Nodes = nodes;
+		m_Capacity = capacity;
+	}
+
+	TimerNode* node = BX_PLACEMENT_NEW(&m_Nodes[m_NumNodes], TimerNode)();
+	node->m_Expiry = 0;
+	node->m_Prev = kInvalidIndex;
+	node->m_Next = kInvalidIndex;
+	node->m_List = kInvalidIndex;
+	node->m_Generation = 0;
+	return m_NumNodes++;
+}
+
+void timer_wheel::freeNode(uint32_t index)
+{
+	TimerNode& node = m_Nodes[index];
+	node.m_Generation++;
+	node.m_List = kInvalidIndex;
+	node.m_Prev = kInvalidIndex;
+	node.m_Next = m_FreeList;
+	m_FreeList = index;
+}
+
+void timer_wheel::link(uint32_t index, uint32_t list)
+{
+	TimerNode& node = m_Nodes[index];
+	const uint32_t head = m_Slots[list];
+	node.m_List = list;
+	node.m_Prev = kInvalidIndex;
+	node.m_Next = head;
+	if (head != kInvalidIndex) {
+		m_Nodes[head].m_Prev = index;
+	}
+	m_Slots[list] = index;
+}
+
+void timer_wheel::unlink(uint32_t index)
+{
+	TimerNode& node = m_Nodes[index];
+	if (node.m_Prev != kInvalidIndex) {
+		m_Nodes[node.m_Prev].m_Next = node.m_Next;
+	} else {
+		m_Slots[node.m_List] = node.m_Next;
+	}
+
+	if (node.m_Next != kInvalidIndex) {
+		m_Nodes[node.m_Next].m_Prev = node.m_Prev;
+	}
+
+	node.m_Prev = kInvalidIndex;
+	node.m_Next = kInvalidIndex;
+}
+
+// Links the node into the slot of the lowest level which covers its expiry.
+void timer_wheel::insert(uint32_t index)
+{
+	TimerNode& node = m_Nodes[index];
+	const uint64_t maxDelay = (1ull << (kNumLevels * kSlotBits)) - 1;
+
+	// Timers cascaded down from upper levels can expire in the current tick, in which
+	// case they land in the level 0 slot which is about to fire.
+	uint64_t expiry = bx::max(node.m_Expiry, m_Now);
+	if (expiry - m_Now > maxDelay) {
+		// Parked in the last level and redistributed when its slot comes up.
+		expiry = m_Now + maxDelay;
+	}
+
+	const uint64_t delta = expiry - m_Now;
+	uint32_t level = 0;
+	while (level < kNumLevels - 1 && delta >= (1ull << ((level + 1) * kSlotBits))) {
+		++level;
+	}
+
+	const uint32_t slot = (uint32_t)(expiry >> (level * kSlotBits)) & (kNumSlots - 1);
+	link(index, level * kNumSlots + slot);
+}
+
+void timer_wheel::cascade(uint32_t level)
+{
+	const uint32_t list = level * kNumSlots + ((uint32_t)(m_Now >> (level * kSlotBits)) & (kNumSlots - 1));
+	uint32_t index = m_Slots[list];
+	m_Slots[list] = kInvalidIndex;
+	while (index != kInvalidIndex) {
+		const uint32_t next = m_Nodes[index].m_Next;
+		insert(index);
+		index = next;
+	}
+}
+
+// Runs the callbacks of the firing list one at a time, without holding the lock while
+// running them.
+uint32_t timer_wheel::fireExpired()
+{
+	uint32_t numFired = 0;
+	for (;;) {
+		callback_type callback;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			const uint32_t index = m_Slots[kFiringList];
+			if (index == kInvalidIndex) {
+				break;
+			}
+
+			unlink(index);
+			callback = std::move(m_Nodes[index].m_Callback);
+			freeNode(index);
+			--m_NumTimers;
+		}
+
+		callback();
+		++numFired;
+	}
+
+	return numFired;
+}
+}
@@ -0,0 +1,532 @@
+#include <stdint.h>
+#include <bx/bx.h>
+#include <bx/math.h> // bx::uint32_cntbits()
+#include "../include/jtl/utf8.h"
+
+#if defined(__AVX2__)
+#	define JTL_UTF8_AVX2 1
+#	define JTL_UTF8_SSSE3 1
+#	define JTL_UTF8_SSE2 1
+#	include <immintrin.h>
+#elif defined(__SSSE3__)
+#	define JTL_UTF8_AVX2 0
+#	define JTL_UTF8_SSSE3 1
+#	define JTL_UTF8_SSE2 1
+#	include <tmmintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define JTL_UTF8_AVX2 0
+#	define JTL_UTF8_SSSE3 0
+#	define JTL_UTF8_SSE2 1
+#	include <emmintrin.h>
+#else
+#	define JTL_UTF8_AVX2 0
+#	define JTL_UTF8_SSSE3 0
+#	define JTL_UTF8_SSE2 0
+#endif
+
+namespace jtl
+{
+static inline bool isContinuation(uint8_t ch)
+{
+	return (ch & 0xC0) == 0x80;
+}
+
+// Returns the length of the valid sequence starting at str or 0 if it's invalid.
+// Follows Table 3-7 (Well-Formed UTF-8 Byte Sequences) of the Unicode standard.
+static inline uint32_t decodeSequence(const uint8_t* str, uint32_t len, uint32_t& codepoint)
+{
+	const uint8_t b0 = str[0];
+	if (b0 < 0x80) {
+		codepoint = b0;
+		return 1;
+	}
+
+	if (b0 < 0xC2) {
+		return 0; // Continuation byte or overlong 2-byte sequence
+	}
+
+	if (b0 < 0xE0) {
+		if (len < 2 || !isContinuation(str[1])) {
+			return 0;
+		}
+
+		codepoint = ((uint32_t)(b0 & 0x1F) << 6) | (str[1] & 0x3F);
+		return 2;
+	}
+
+	if (b0 < 0xF0) {
+		if (len < 3) {
+			return 0;
+		}
+
+		const uint8_t b1 = str[1];
+		const uint8_t minB1 = b0 == 0xE0 ? 0xA0 : 0x80; // Overlong
+		const uint8_t maxB1 = b0 == 0xED ? 0x9F : 0xBF; // Surrogates
+		if (b1 < minB1 || b1 > maxB1 || !isContinuation(str[2])) {
+			return 0;
+		}
+
+		codepoint = ((uint32_t)(b0 & 0x0F) << 12) | ((uint32_t)(b1 & 0x3F) << 6) | (str[2] & 0x3F);
+		return 3;
+	}
+
+	if (b0 < 0xF5) {
+		if (len < 4) {
+			return 0;
+		}
+
+		const uint8_t b1 = str[1];
+		const uint8_t minB1 = b0 == 0xF0 ? 0x90 : 0x80; // Overlong
+		const uint8_t maxB1 = b0 == 0xF4 ? 0x8F : 0xBF; // > U+10FFFF
+		if (b1 < minB1 || b1 > maxB1 || !isContinuation(str[2]) || !isContinuation(str[3])) {
+			return 0;
+		}
+
+		codepoint = ((uint32_t)(b0 & 0x07) << 18) | ((uint32_t)(b1 & 0x3F) << 12) | ((uint32_t)(str[2] & 0x3F) << 6) | (str[3] & 0x3F);
+		return 4;
+	}
+
+	return 0;
+}
+
+#if !JTL_UTF8_SSSE3
+static bool validateScalar(const uint8_t* str, uint32_t len)
+{
+	uint32_t i = 0;
+	while (i < len) {
+		// Skip ASCII 8 bytes at a time.
+		if (i + 8 <= len) {
+			uint64_t block;
+			bx::memCopy(&block, &str[i], sizeof(uint64_t));
+			if ((block & 0x8080808080808080ull) == 0) {
+				i += 8;
+				continue;
+			}
+		}
+
+		uint32_t codepoint;
+		const uint32_t n = decodeSequence(&str[i], len - i, codepoint);
+		if (!n) {
+			return false;
+		}
+		i += n;
+	}
+
+	return true;
+}
+#endif
+
+#if JTL_UTF8_SSSE3
+// SIMD validation based on "Validating UTF-8 In Less Than One Instruction Per Byte"
+// (Keiser & Lemire, 2021), as implemented in simdjson/simdutf. Each byte is classified
+// using three 16-entry lookups (high nibble of the previous byte, low nibble of the
+// previous byte, high nibble of the current byte) whose AND is non-zero for invalid
+// 2-byte combinations. 3- and 4-byte sequences are checked by making sure that exactly
+// the bytes that must be continuations are continuations.
+enum
+{
+	TOO_SHORT = 1 << 0,      // 11______ 0_______, 11______ 11______
+	TOO_LONG = 1 << 1,       // 0_______ 10______
+	OVERLONG_3 = 1 << 2,     // 11100000 100_____
+	TOO_LARGE = 1 << 3,      // 11110100 1001____, 11110100 101_____, 11110101+ 1001____, 11110101+ 101_____
+	SURROGATE = 1 << 4,      // 11101101 101_____
+	OVERLONG_2 = 1 << 5,     // 1100000_ 10______
+	TOO_LARGE_1000 = 1 << 6, // 11110101+ 1000____
+	OVERLONG_4 = 1 << 6,     // 11110000 1000____
+	TWO_CONTS = 1 << 7,      // 10______ 10______
+	CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS,
+};
+
+#define JTL_UTF8_BYTE_1_HIGH \
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, \
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, \
+	TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS, \
+	TOO_SHORT | OVERLONG_2, \
+	TOO_SHORT, \
+	TOO_SHORT | OVERLONG_3 | SURROGATE, \
+	TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+
+#define JTL_UTF8_BYTE_1_LOW \
+	CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, \
+	CARRY | OVERLONG_2, \
+	CARRY, \
+	CARRY, \
+	CARRY | TOO_LARGE, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000, \
+	CARRY | TOO_LARGE | TOO_LARGE_1000
+
+#define JTL_UTF8_BYTE_2_HIGH \
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, \
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, \
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4, \
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE, \
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, \
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, \
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+
+static inline __m128i setTable128(
+	uint8_t t0, uint8_t t1, uint8_t t2, uint8_t t3, uint8_t t4, uint8_t t5, uint8_t t6, uint8_t t7,
+	uint8_t t8, uint8_t t9, uint8_t t10, uint8_t t11, uint8_t t12, uint8_t t13, uint8_t t14, uint8_t t15)
+{
+	return _mm_setr_epi8((char)t0, (char)t1, (char)t2, (char)t3, (char)t4, (char)t5, (char)t6, (char)t7
+		, (char)t8, (char)t9, (char)t10, (char)t11, (char)t12, (char)t13, (char)t14, (char)t15);
+}
+
+struct ValidatorSSSE3
+{
+	__m128i m_Error;
+	__m128i m_PrevInput;
+	__m128i m_PrevIncomplete;
+
+	ValidatorSSSE3()
+		: m_Error(_mm_setzero_si128())
+		, m_PrevInput(_mm_setzero_si128())
+		, m_PrevIncomplete(_mm_setzero_si128())
+	{
+	}
+
+	void checkBlock(__m128i input)
+	{
+		if (_mm_movemask_epi8(input) == 0) {
+			// ASCII block. Only need to make sure the previous block didn't end in the middle
+			// of a multi-byte sequence.
+			m_Error = _mm_or_si128(m_Error, m_PrevIncomplete);
+			m_PrevIncomplete = _mm_setzero_si128();
+			m_PrevInput = input;
+			return;
+		}
+
+		const __m128i nibbleMask = _mm_set1_epi8(0x0F);
+		const __m128i prev1 = _mm_alignr_epi8(input, m_PrevInput, 16 - 1);
+		const __m128i byte1High = _mm_shuffle_epi8(setTable128(JTL_UTF8_BYTE_1_HIGH), _mm_and_si128(_mm_srli_epi16(prev1, 4), nibbleMask));
+		const __m128i byte1Low = _mm_shuffle_epi8(setTable128(JTL_UTF8_BYTE_1_LOW), _mm_and_si128(prev1, nibbleMask));
+		const __m128i byte2High = _mm_shuffle_epi8(setTable128(JTL_UTF8_BYTE_2_HIGH), _mm_and_si128(_mm_srli_epi16(input, 4), nibbleMask));
+		const __m128i specialCases = _mm_and_si128(_mm_and_si128(byte1High, byte1Low), byte2High);
+
+		// Bytes 2 positions after a 3/4-byte lead or 3 positions after a 4-byte lead must be
+		// continuations. Those are exactly the ones flagged as TWO_CONTS above.
+		const __m128i prev2 = _mm_alignr_epi8(input, m_PrevInput, 16 - 2);
+		const __m128i prev3 = _mm_alignr_epi8(input, m_PrevInput, 16 - 3);
+		const __m128i isThirdByte = _mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xE0 - 0x80)));
+		const __m128i isFourthByte = _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xF0 - 0x80)));
+		const __m128i must23 = _mm_and_si128(_mm_or_si128(isThirdByte, isFourthByte), _mm_set1_epi8((char)0x80));
+
+		m_Error = _mm_or_si128(m_Error, _mm_xor_si128(must23, specialCases));
+
+		// Lead bytes in the last 3 positions which need more bytes than what's left in the block.
+		const __m128i maxValue = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+			, (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+		m_PrevIncomplete = _mm_subs_epu8(input, maxValue);
+		m_PrevInput = input;
+	}
+
+	bool finish()
+	{
+		m_Error = _mm_or_si128(m_Error, m_PrevIncomplete);
+		return _mm_movemask_epi8(_mm_cmpeq_epi8(m_Error, _mm_setzero_si128())) == 0xFFFF;
+	}
+};
+#endif
+
+#if JTL_UTF8_AVX2
+static inline __m256i setTable256(__m128i table)
+{
+	return _mm256_broadcastsi128_si256(table);
+}
+
+struct ValidatorAVX2
+{
+	__m256i m_Error;
+	__m256i m_PrevInput;
+	__m256i m_PrevIncomplete;
+
+	ValidatorAVX2()
+		: m_Error(_mm256_setzero_si256())
+		, m_PrevInput(_mm256_setzero_si256())
+		, m_PrevIncomplete(_mm256_setzero_si256())
+	{
+	}
+
+	template<int N>
+	static inline __m256i prev(__m256i input, __m256i prevInput)
+	{
+		return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prevInput, input, 0x21), 16 - N);
+	}
+
+	void checkBlock(__m256i input)
+	{
+		if (_mm256_movemask_epi8(input) == 0) {
+			m_Error = _mm256_or_si256(m_Error, m_PrevIncomplete);
+			m_PrevIncomplete = _mm256_setzero_si256();
+			m_PrevInput = input;
+			return;
+		}
+
+		const __m256i nibbleMask = _mm256_set1_epi8(0x0F);
+		const __m256i prev1 = prev<1>(input, m_PrevInput);
+		const __m256i byte1High = _mm256_shuffle_epi8(setTable256(setTable128(JTL_UTF8_BYTE_1_HIGH)), _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibbleMask));
+		const __m256i byte1Low = _mm256_shuffle_epi8(setTable256(setTable128(JTL_UTF8_BYTE_1_LOW)), _mm256_and_si256(prev1, nibbleMask));
+		const __m256i byte2High = _mm256_shuffle_epi8(setTable256(setTable128(JTL_UTF8_BYTE_2_HIGH)), _mm256_and_si256(_mm256_srli_epi16(input, 4), nibbleMask));
+		const __m256i specialCases = _mm256_and_si256(_mm256_and_si256(byte1High, byte1Low), byte2High);
+
+		const __m256i isThirdByte = _mm256_subs_epu8(prev<2>(input, m_PrevInput), _mm256_set1_epi8((char)(0xE0 - 0x80)));
+		const __m256i isFourthByte = _mm256_subs_epu8(prev<3>(input, m_PrevInput), _mm256_set1_epi8((char)(0xF0 - 0x80)));
+		const __m256i must23 = _mm256_and_si256(_mm256_or_si256(isThirdByte, isFourthByte), _mm256_set1_epi8((char)0x80));
+
+		m_Error = _mm256_or_si256(m_Error, _mm256_xor_si256(must23, specialCases));
+
+		const __m256i maxValue = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+			, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+			, (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+		m_PrevIncomplete = _mm256_subs_epu8(input, maxValue);
+		m_PrevInput = input;
+	}
+
+	bool finish()
+	{
+		m_Error = _mm256_or_si256(m_Error, m_PrevIncomplete);
+		return _mm256_testz_si256(m_Error, m_Error) != 0;
+	}
+};
+#endif
+
+bool utf8_validate(const char* str, uint32_t len)
+{
+	const uint8_t* s = (const uint8_t*)str;
+
+#if JTL_UTF8_AVX2
+	typedef ValidatorAVX2 ValidatorT;
+	typedef __m256i VecT;
+#	define JTL_UTF8_LOADU(_ptr) _mm256_loadu_si256((const __m256i*)(_ptr))
+#elif JTL_UTF8_SSSE3
+	typedef ValidatorSSSE3 ValidatorT;
+	typedef __m128i VecT;
+#	define JTL_UTF8_LOADU(_ptr) _mm_loadu_si128((const __m128i*)(_ptr))
+#endif
+
+#if JTL_UTF8_SSSE3
+	const uint32_t kBlockSize = sizeof(VecT);
+
+	ValidatorT validator;
+	uint32_t i = 0;
+	for (; i + kBlockSize <= len; i += kBlockSize) {
+		validator.checkBlock(JTL_UTF8_LOADU(&s[i]));
+	}
+
+	if (i < len) {
+		// Zero padding is ASCII so it doesn't affect the result (other than catching
+		// truncated sequences at the end).
+		uint8_t tail[sizeof(VecT)] = { 0 };
+		bx::memCopy(tail, &s[i], len - i);
+		validator.checkBlock(JTL_UTF8_LOADU(tail));
+	}
+
+	return validator.finish();
+#	undef JTL_UTF8_LOADU
+#else
+	return validateScalar(s, len);
+#endif
+}
+
+uint32_t utf8_length(const char* str, uint32_t len)
+{
+	const uint8_t* s = (const uint8_t*)str;
+
+	// Count all bytes which aren't continuation bytes (10xxxxxx, i.e. <= -65 as int8).
+	uint32_t count = 0;
+	uint32_t i = 0;
+#if JTL_UTF8_SSE2
+	const __m128i threshold = _mm_set1_epi8(-65);
+	for (; i + 16 <= len; i += 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)&s[i]);
+		count += bx::uint32_cntbits((uint32_t)_mm_movemask_epi8(_mm_cmpgt_epi8(v, threshold)));
+	}
+#endif
+	for (; i < len; ++i) {
+		count += isContinuation(s[i]) ? 0 : 1;
+	}
+
+	return count;
+}
+
+uint32_t utf8_decode(const char* str, uint32_t len, uint32_t& codepoint)
+{
+	if (!len) {
+		codepoint = kUnicodeReplacementChar;
+		return 0;
+	}
+
+	const uint32_t n = decodeSequence((const uint8_t*)str, len, codepoint);
+	if (!n) {
+		codepoint = kUnicodeReplacementChar;
+	}
+
+	return n;
+}
+
+uint32_t utf8_encode(char* dst, uint32_t codepoint)
+{
+	uint8_t* d = (uint8_t*)dst;
+	if (codepoint < 0x80) {
+		d[0] = (uint8_t)codepoint;
+		return 1;
+	} else if (codepoint < 0x800) {
+		d[0] = (uint8_t)(0xC0 | (codepoint >> 6));
+		d[1] = (uint8_t)(0x80 | (codepoint & 0x3F));
+		return 2;
+	} else if (codepoint < 0x10000) {
+		if (codepoint >= 0xD800 && codepoint <= 0xDFFF) {
+			return 0;
+		}
+
+		d[0] = (uint8_t)(0xE0 | (codepoint >> 12));
+		d[1] = (uint8_t)(0x80 | ((codepoint >> 6) & 0x3F));
+		d[2] = (uint8_t)(0x80 | (codepoint & 0x3F));
+		return 3;
+	} else if (codepoint <= 0x10FFFF) {
+		d[0] = (uint8_t)(0xF0 | (codepoint >> 18));
+		d[1] = (uint8_t)(0x80 | ((codepoint >> 12) & 0x3F));
+		d[2] = (uint8_t)(0x80 | ((codepoint >> 6) & 0x3F));
+		d[3] = (uint8_t)(0x80 | (codepoint & 0x3F));
+		return 4;
+	}
+
+	return 0;
+}
+
+// Widens the ASCII prefix of str 16 bytes at a time. Returns the number of bytes processed.
+template<typename T>
+static inline uint32_t widenASCII(const uint8_t* str, uint32_t len, T* dst)
+{
+	uint32_t i = 0;
+#if JTL_UTF8_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= len; i += 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)&str[i]);
+		if (_mm_movemask_epi8(v) != 0) {
+			break;
+		}
+
+		const __m128i lo = _mm_unpacklo_epi8(v, zero);
+		const __m128i hi = _mm_unpackhi_epi8(v, zero);
+		if (sizeof(T) == 2) {
+			_mm_storeu_si128((__m128i*)&dst[i], lo);
+			_mm_storeu_si128((__m128i*)&dst[i + 8], hi);
+		} else {
+			_mm_storeu_si128((__m128i*)&dst[i + 0], _mm_unpacklo_epi16(lo, zero));
+			_mm_storeu_si128((__m128i*)&dst[i + 4], _mm_unpackhi_epi16(lo, zero));
+			_mm_storeu_si128((__m128i*)&dst[i + 8], _mm_unpacklo_epi16(hi, zero));
+			_mm_storeu_si128((__m128i*)&dst[i + 12], _mm_unpackhi_epi16(hi, zero));
+		}
+	}
+#else
+	BX_UNUSED(str, len, dst);
+#endif
+	return i;
+}
+
+uint32_t utf8_to_utf16(const char* str, uint32_t len, uint16_t* dst)
+{
+	const uint8_t* s = (const uint8_t*)str;
+	uint16_t* d = dst;
+	uint32_t i = 0;
+	while (i < len) {
+		const uint32_t numASCII = widenASCII(&s[i], len - i, d);
+		i += numASCII;
+		d += numASCII;
+
+		// Decode (at least) one code point before trying the fast path again.
+		for (uint32_t end = bx::min(i + 16, len); i < end; ) {
+			uint32_t codepoint;
+			const uint32_t n = decodeSequence(&s[i], len - i, codepoint);
+			if (!n) {
+				return kInvalidUTF;
+			}
+			i += n;
+
+			if (codepoint < 0x10000) {
+				*d++ = (uint16_t)codepoint;
+			} else {
+				codepoint -= 0x10000;
+				*d++ = (uint16_t)(0xD800 + (codepoint >> 10));
+				*d++ = (uint16_t)(0xDC00 + (codepoint & 0x3FF));
+			}
+		}
+	}
+
+	return (uint32_t)(d - dst);
+}
+
+uint32_t utf8_to_utf32(const char* str, uint32_t len, uint32_t* dst)
+{
+	const uint8_t* s = (const uint8_t*)str;
+	uint32_t* d = dst;
+	uint32_t i = 0;
+	while (i < len) {
+		const uint32_t numASCII = widenASCII(&s[i], len - i, d);
+		i += numASCII;
+		d += numASCII;
+
+		for (uint32_t end = bx::min(i + 16, len); i < end; ) {
+			uint32_t codepoint;
+			const uint32_t n = decodeSequence(&s[i], len - i, codepoint);
+			if (!n) {
+				return kInvalidUTF;
+			}
+			i += n;
+			*d++ = codepoint;
+		}
+	}
+
+	return (uint32_t)(d - dst);
+}
+
+uint32_t utf16_to_utf8(const uint16_t* str, uint32_t len, char* dst)
+{
+	char* d = dst;
+	for (uint32_t i = 0; i < len; ++i) {
+		uint32_t codepoint = str[i];
+		if (codepoint < 0x80) {
+			*d++ = (char)codepoint;
+			continue;
+		}
+
+		if (codepoint >= 0xD800 && codepoint <= 0xDFFF) {
+			// Surrogate pair: high (D800-DBFF) followed by low (DC00-DFFF)
+			if (codepoint > 0xDBFF || i + 1 == len || str[i + 1] < 0xDC00 || str[i + 1] > 0xDFFF) {
+				return kInvalidUTF;
+			}
+
+			codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (str[i + 1] - 0xDC00);
+			++i;
+		}
+
+		d += utf8_encode(d, codepoint);
+	}
+
+	return (uint32_t)(d - dst);
+}
+
+uint32_t utf32_to_utf8(const uint32_t* str, uint32_t len, char* dst)
+{
+	char* d = dst;
+	for (uint32_t i = 0; i < len; ++i) {
+		const uint32_t n = utf8_encode(d, str[i]);
+		if (!n) {
+			return kInvalidUTF;
+		}
+		d += n;
+	}
+
+	return (uint32_t)(d - dst);
+}
+}